@@ -0,0 +1,182 @@
+#include "bulk_dedup.h"
+#include "circle_store.h"
+#include "thread_pool.h"
+#include <array>
+#include <algorithm>
+#include <ranges>
+#include <bit>
+
+namespace r = std::ranges;
+namespace rv = std::ranges::views;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr size_t k_blocks_per_thread = 4;
+    constexpr size_t k_min_block_size = 16384;
+    constexpr int k_radix_bits = 8;
+    constexpr size_t k_radix = size_t{ 1 } << k_radix_bits;
+    constexpr size_t k_prefetch_distance = 16;
+
+    // circles are grouped by this many more bits of the hash of their keys than it takes to
+    // number them, which leaves few runs with more than one key to tell apart.
+    constexpr int k_extra_hash_bits = 16;
+
+    // a sort key and what it is attached to.
+    struct tagged {
+        uint64_t key;
+        uint64_t value;
+    };
+
+    // [0, n) split into contiguous blocks, a few per thread unless they would be tiny.
+    class block_range {
+        size_t n_;
+        size_t size_;
+
+    public:
+        size_t count;
+
+        block_range(const ici::thread_pool& pool, size_t n) : n_(n) {
+            auto most = static_cast<size_t>(pool.size()) * k_blocks_per_thread;
+            count = std::clamp<size_t>((n + k_min_block_size - 1) / k_min_block_size, 1, most);
+            size_ = (n + count - 1) / count;
+        }
+
+        size_t begin(size_t block) const {
+            return std::min(n_, block * size_);
+        }
+
+        size_t end(size_t block) const {
+            return std::min(n_, (block + 1) * size_);
+        }
+    };
+
+    void prefetch(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(p);
+#endif
+    }
+
+    // a stable least significant digit first radix sort by the low key_bits bits of the key,
+    // the rest being zero. In each pass every block counts its digits, the counts give each
+    // block its own range of the output for each digit, and the blocks scatter into their
+    // ranges in parallel. A pass whose digit is the same for every item is skipped.
+    void radix_sort(ici::thread_pool& pool, std::vector<tagged>& items, int key_bits) {
+        auto n = items.size();
+        block_range blocks(pool, n);
+        std::vector<tagged> sorted(n);
+        std::vector<std::array<size_t, k_radix>> offsets(blocks.count);
+
+        for (int shift = 0; shift < key_bits; shift += k_radix_bits) {
+            auto digit = [shift](const tagged& t) {
+                return static_cast<size_t>((t.key >> shift) & (k_radix - 1));
+            };
+            pool.parallel_for(blocks.count,
+                [&](size_t b) {
+                    offsets[b].fill(0);
+                    for (auto i = blocks.begin(b); i < blocks.end(b); ++i) {
+                        ++offsets[b][digit(items[i])];
+                    }
+                }
+            );
+
+            size_t total = 0;
+            bool uniform = false;
+            for (size_t d = 0; d < k_radix; ++d) {
+                size_t count = 0;
+                for (auto& offset : offsets) {
+                    auto c = offset[d];
+                    offset[d] = total;
+                    total += c;
+                    count += c;
+                }
+                uniform = uniform || count == n;
+            }
+            if (uniform) {
+                continue;
+            }
+
+            pool.parallel_for(blocks.count,
+                [&](size_t b) {
+                    auto& offset = offsets[b];
+                    for (auto i = blocks.begin(b); i < blocks.end(b); ++i) {
+                        sorted[offset[digit(items[i])]++] = items[i];
+                    }
+                }
+            );
+            items.swap(sorted);
+        }
+    }
+}
+
+std::vector<ici::first_occurrence> ici::first_occurrences(thread_pool& pool,
+        const circle_store& store, const circle_buffer& circles) {
+    auto n = circles.size();
+    block_range blocks(pool, n);
+    auto hash_bits = std::min(64, static_cast<int>(std::bit_width(n)) + k_extra_hash_bits);
+
+    std::vector<tagged> tags(n);
+    pool.parallel_for(blocks.count,
+        [&](size_t b) {
+            for (auto i = blocks.begin(b); i < blocks.end(b); ++i) {
+                auto hash = circle_set::partition_hash{}(store.discretize(circles[i]));
+                tags[i] = { hash >> (64 - hash_bits), i };
+            }
+        }
+    );
+    radix_sort(pool, tags, hash_bits);
+
+    // each block scans the runs of equal hashes that start in it, to their ends. Within a
+    // run the circles are in buffer order, so the first circle with each key is the first
+    // occurrence of that key; only runs of more than one circle need their keys compared.
+    // The circles are read in sorted order, all over the buffer, so they are prefetched.
+    std::vector<std::vector<tagged>> block_firsts(blocks.count);
+    pool.parallel_for(blocks.count,
+        [&](size_t b) {
+            std::vector<circle_set::discretized_circle> keys;
+            auto i = blocks.begin(b);
+            while (i > 0 && i < blocks.end(b) && tags[i].key == tags[i - 1].key) {
+                ++i;
+            }
+            while (i < blocks.end(b)) {
+                auto run_end = i + 1;
+                while (run_end < n && tags[run_end].key == tags[i].key) {
+                    ++run_end;
+                }
+                keys.clear();
+                for (auto j = i; j < run_end; ++j) {
+                    if (j + k_prefetch_distance < n) {
+                        auto ahead = tags[j + k_prefetch_distance].value;
+                        prefetch(circles.x() + ahead);
+                        prefetch(circles.y() + ahead);
+                        prefetch(circles.r() + ahead);
+                    }
+                    auto c = circles[tags[j].value];
+                    if (run_end - i > 1) {
+                        auto key = store.discretize(c);
+                        if (r::find(keys, key) != keys.end()) {
+                            continue;
+                        }
+                        keys.push_back(key);
+                    }
+                    auto existing = store.find(c);
+                    block_firsts[b].push_back(
+                        { tags[j].value, existing ? *existing : first_occurrence::none }
+                    );
+                }
+                i = run_end;
+            }
+        }
+    );
+
+    // back into buffer order, sorting by position.
+    std::vector<tagged> firsts;
+    for (const auto& block : block_firsts) {
+        firsts.insert(firsts.end(), block.begin(), block.end());
+    }
+    radix_sort(pool, firsts, static_cast<int>(std::bit_width(n)));
+    return firsts | rv::transform(
+            [](const tagged& t) { return first_occurrence{ t.key, t.value }; }
+        ) | r::to<std::vector>();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "geometry.h"
+#include "circle_buffer.h"
+#include <vector>
+#include <limits>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    class thread_pool;
+    class circle_store;
+
+    // the first of the circles of a buffer that share a discretized key, and the index of the
+    // circle in the store with that key, if the store already has one.
+    struct first_occurrence {
+        static constexpr size_t none = std::numeric_limits<size_t>::max();
+
+        size_t index;
+        size_t existing;
+    };
+
+    // deduplicates a whole generation's images at once, by sorting rather than hashing them
+    // one at a time. Each circle is tagged with a hash of its discretized key, cut to a few
+    // more bits than it takes to number the circles, and the tags are radix sorted, in
+    // parallel and stably, so circles with the same key end up in runs in the order they
+    // were generated. The runs are scanned in parallel, telling apart the rare distinct keys
+    // that share a hash, and only the first circle of each key is looked up in the store.
+    // Returns the first occurrences in the order of the buffer.
+
+    std::vector<first_occurrence> first_occurrences(thread_pool& pool,
+        const circle_store& store, const circle_buffer& circles);
+
+}
@@ -0,0 +1,73 @@
+#include "candidate_queue.h"
+#include <limits>
+
+/*------------------------------------------------------------------------------------------------*/
+
+ici::candidate_queue::candidate_queue(double eps, tolerance_scale scale,
+        priority_fn priority) :
+        keys_(eps, scale),
+        priority_(std::move(priority)),
+        capacity_(std::numeric_limits<size_t>::max()) {
+}
+
+void ici::candidate_queue::drop_worst() {
+    auto worst = std::prev(queue_.end());
+    auto [p, r, x, y, rad] = worst->first;
+    index_.erase(key{ x, y, rad });
+    queue_.erase(worst);
+}
+
+void ici::candidate_queue::set_capacity(size_t capacity) {
+    capacity_ = capacity;
+    while (queue_.size() > capacity_) {
+        drop_worst();
+    }
+}
+
+bool ici::candidate_queue::admits(const circle& c) const {
+    // a cheap test, ignoring the tie breaks, that the circle could be pushed.
+    if (queue_.size() < capacity_) {
+        return true;
+    }
+    const auto& [priority, radius, x, y, r] = std::prev(queue_.end())->first;
+    auto p = priority_(c);
+    return p > priority || (p == priority && c.radius >= radius);
+}
+
+void ici::candidate_queue::push(const candidate& cand) {
+    if (capacity_ == 0) {
+        return;
+    }
+    auto k = keys_.discretize(cand.c);
+    if (index_.contains(k)) {
+        return;
+    }
+
+    // ties in priority go to the larger circle.
+    rank rnk{ priority_(cand.c), cand.c.radius, k.x, k.y, k.r };
+    if (queue_.size() == capacity_) {
+        if (!(rnk > std::prev(queue_.end())->first)) {
+            return;
+        }
+        drop_worst();
+    }
+    queue_.emplace(rnk, cand);
+    index_.insert(k);
+}
+
+ici::candidate_queue::candidate ici::candidate_queue::pop() {
+    auto best = queue_.begin();
+    auto cand = best->second;
+    auto [p, r, x, y, rad] = best->first;
+    index_.erase(key{ x, y, rad });
+    queue_.erase(best);
+    return cand;
+}
+
+bool ici::candidate_queue::empty() const {
+    return queue_.empty();
+}
+
+size_t ici::candidate_queue::size() const {
+    return queue_.size();
+}
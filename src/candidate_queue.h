@@ -0,0 +1,55 @@
+#pragma once
+
+#include "geometry.h"
+#include "circle_set.h"
+#include "circle_store.h"
+#include "mobius.h"
+#include <map>
+#include <unordered_set>
+#include <functional>
+#include <optional>
+#include <tuple>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // circles that have been found but not yet accepted into the store, highest priority
+    // first, deduplicated to within eps. At most capacity candidates are kept: a circle
+    // outranked by capacity others can never be accepted before the budget that capacity
+    // stands for runs out, so it is dropped.
+
+    class candidate_queue {
+    public:
+        struct candidate {
+            circle c;
+            lineage parents;
+            std::optional<circle_word> word;
+        };
+
+        using priority_fn = std::function<double(const circle&)>;
+
+    private:
+        using key = circle_set::discretized_circle;
+        using rank = std::tuple<double, double, int64_t, int64_t, int64_t>;
+
+        circle_set keys_; // empty; discretizes circles the same way the store does
+        priority_fn priority_;
+        size_t capacity_;
+        std::map<rank, candidate, std::greater<rank>> queue_;
+        std::unordered_set<key, circle_set::hash_discretized_circle> index_;
+
+        void drop_worst();
+
+    public:
+        candidate_queue(double eps, tolerance_scale scale, priority_fn priority);
+
+        void set_capacity(size_t capacity);
+        bool admits(const circle& c) const;
+        void push(const candidate& cand);
+        candidate pop();
+        bool empty() const;
+        size_t size() const;
+    };
+
+}
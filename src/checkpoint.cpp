@@ -0,0 +1,113 @@
+#include "checkpoint.h"
+#include "util.h"
+#include <fstream>
+#include <format>
+#include <print>
+#include <ranges>
+#include <algorithm>
+#include <cctype>
+
+namespace fs = std::filesystem;
+namespace r = std::ranges;
+namespace rv = std::ranges::views;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr uint64_t k_magic = 0x31544b4349435449; // "ITCICKT1"
+    constexpr auto k_prefix = "iteration-";
+    constexpr auto k_extension = ".ckpt";
+
+    std::optional<int> file_iteration(const fs::path& path) {
+        auto name = path.filename().string();
+        if (!name.starts_with(k_prefix) || path.extension() != k_extension) {
+            return {};
+        }
+        auto digits = path.stem().string().substr(std::string(k_prefix).size());
+        if (digits.empty() || !r::all_of(digits, [](char ch) { return std::isdigit(ch); })) {
+            return {};
+        }
+        return std::stoi(digits);
+    }
+}
+
+ici::checkpointer::checkpointer(const std::string& dir, const input& inp) :
+        dir_(dir), key_(generation_key(inp, false)), eps_(inp.eps),
+        tolerance_(inp.tolerance),
+        merge_near_(inp.merge_near_duplicates) {
+}
+
+fs::path ici::checkpointer::file(int iteration) const {
+    return dir_ / std::format("{}{}{}", k_prefix, iteration, k_extension);
+}
+
+void ici::checkpointer::write(int iteration, const circle_store& store,
+        std::span<const circle_word> words) const {
+    // written under a temporary name and then renamed, so a run killed while writing
+    // leaves the previous checkpoints intact.
+    fs::create_directories(dir_);
+    auto path = file(iteration);
+    auto temp = fs::path(path).replace_extension(".tmp");
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        write_binary(out, k_magic);
+        write_binary(out, std::vector<char>(key_.begin(), key_.end()));
+        write_binary(out, iteration);
+        store.write(out);
+        write_binary(out, std::vector<circle_word>(words.begin(), words.end()));
+        if (!out) {
+            throw std::runtime_error(std::format("unable to write checkpoint {}", temp.string()));
+        }
+    }
+    fs::rename(temp, path);
+}
+
+std::optional<ici::checkpoint> ici::checkpointer::read(const fs::path& path) const {
+    std::ifstream in(path, std::ios::binary);
+    if (!in || read_binary<uint64_t>(in) != k_magic) {
+        return {};
+    }
+    auto key = read_binary_vector<char>(in);
+    if (!r::equal(key, key_)) {
+        return {};
+    }
+    auto iteration = read_binary<int>(in);
+    auto store = circle_store::read(in, eps_, tolerance_, merge_near_);
+    auto words = read_binary_vector<circle_word>(in);
+    if (store.generation() != iteration || (!words.empty() && words.size() != store.size())) {
+        throw std::runtime_error("inconsistent checkpoint");
+    }
+    return checkpoint{ iteration, std::move(store), std::move(words) };
+}
+
+std::optional<ici::checkpoint> ici::checkpointer::read_latest(int max_iteration) const {
+    if (!fs::is_directory(dir_)) {
+        return {};
+    }
+    std::vector<std::tuple<int, fs::path>> files;
+    for (const auto& entry : fs::directory_iterator(dir_)) {
+        auto iteration = file_iteration(entry.path());
+        if (iteration && *iteration > 0 && *iteration <= max_iteration) {
+            files.emplace_back(*iteration, entry.path());
+        }
+    }
+    r::sort(files, std::greater<>{});
+
+    for (const auto& [iteration, path] : files) {
+        try {
+            auto ckpt = read(path);
+            if (ckpt) {
+                return ckpt;
+            }
+            std::println("  checkpoint {} is for different seeds or settings, skipping",
+                path.filename().string()
+            );
+        } catch (const std::runtime_error& e) {
+            std::println("  checkpoint {} is unreadable ({}), skipping",
+                path.filename().string(), e.what()
+            );
+        }
+    }
+    return {};
+}
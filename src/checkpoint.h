@@ -0,0 +1,47 @@
+#pragma once
+
+#include "circle_store.h"
+#include "mobius.h"
+#include "input.h"
+#include <filesystem>
+#include <optional>
+#include <vector>
+#include <string>
+#include <span>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // generation state as of the end of an iteration: the store, which holds the output so
+    // far and the previous and current frontiers, and, with the Möbius engine, the word of
+    // every circle in it.
+    struct checkpoint {
+        int iteration;
+        circle_store store;
+        std::vector<circle_word> words;
+    };
+
+    // writes a checkpoint file to a directory after each iteration and finds the newest one
+    // a run can resume from. Every file records the seeds, eps and the other settings that
+    // change what is generated, and only a run matching all of them exactly resumes from it.
+
+    class checkpointer {
+        std::filesystem::path dir_;
+        std::string key_;
+        double eps_;
+        tolerance_scale tolerance_;
+        bool merge_near_;
+
+        std::filesystem::path file(int iteration) const;
+        std::optional<checkpoint> read(const std::filesystem::path& path) const;
+
+    public:
+        checkpointer(const std::string& dir, const input& inp);
+
+        void write(int iteration, const circle_store& store,
+            std::span<const circle_word> words) const;
+        std::optional<checkpoint> read_latest(int max_iteration) const;
+    };
+
+}
@@ -0,0 +1,79 @@
+#include "circle_buffer.h"
+
+/*------------------------------------------------------------------------------------------------*/
+
+ici::circle_buffer::circle_buffer() {
+}
+
+ici::circle_buffer::circle_buffer(std::span<const circle> circles) {
+    reserve(circles.size());
+    for (const auto& c : circles) {
+        push_back(c);
+    }
+}
+
+void ici::circle_buffer::push_back(const circle& c) {
+    x_.push_back(c.loc.x);
+    y_.push_back(c.loc.y);
+    r_.push_back(c.radius);
+}
+
+void ici::circle_buffer::set(size_t i, const circle& c) {
+    x_[i] = c.loc.x;
+    y_[i] = c.loc.y;
+    r_[i] = c.radius;
+}
+
+void ici::circle_buffer::resize(size_t n) {
+    x_.resize(n);
+    y_.resize(n);
+    r_.resize(n);
+}
+
+void ici::circle_buffer::reserve(size_t n) {
+    x_.reserve(n);
+    y_.reserve(n);
+    r_.reserve(n);
+}
+
+void ici::circle_buffer::clear() {
+    x_.clear();
+    y_.clear();
+    r_.clear();
+}
+
+ici::circle ici::circle_buffer::operator[](size_t i) const {
+    return { {x_[i], y_[i]}, r_[i] };
+}
+
+size_t ici::circle_buffer::size() const {
+    return r_.size();
+}
+
+bool ici::circle_buffer::empty() const {
+    return r_.empty();
+}
+
+double* ici::circle_buffer::x() {
+    return x_.data();
+}
+
+double* ici::circle_buffer::y() {
+    return y_.data();
+}
+
+double* ici::circle_buffer::r() {
+    return r_.data();
+}
+
+const double* ici::circle_buffer::x() const {
+    return x_.data();
+}
+
+const double* ici::circle_buffer::y() const {
+    return y_.data();
+}
+
+const double* ici::circle_buffer::r() const {
+    return r_.data();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "geometry.h"
+#include <vector>
+#include <span>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // circles stored as a structure of arrays, i.e. separate contiguous arrays of center x
+    // coordinates, center y coordinates and radii, so they can be loaded into SIMD registers
+    // several at a time.
+
+    class circle_buffer {
+        std::vector<double> x_;
+        std::vector<double> y_;
+        std::vector<double> r_;
+
+    public:
+        circle_buffer();
+        circle_buffer(std::span<const circle> circles);
+
+        void push_back(const circle& c);
+        void set(size_t i, const circle& c);
+        void resize(size_t n);
+        void reserve(size_t n);
+        void clear();
+
+        circle operator[](size_t i) const;
+        size_t size() const;
+        bool empty() const;
+
+        double* x();
+        double* y();
+        double* r();
+        const double* x() const;
+        const double* y() const;
+        const double* r() const;
+    };
+
+}
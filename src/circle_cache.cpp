@@ -0,0 +1,98 @@
+#include "circle_cache.h"
+#include "util.h"
+#include <fstream>
+#include <format>
+#include <ranges>
+#include <algorithm>
+#include <system_error>
+
+namespace fs = std::filesystem;
+namespace r = std::ranges;
+namespace rv = std::ranges::views;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr uint64_t k_magic = 0x31534543524943; // "CIRCES1"
+    constexpr auto k_extension = ".circles";
+
+    // 64-bit FNV-1a, which unlike std::hash is the same from one build to the next.
+    uint64_t fnv1a(const std::string& str) {
+        uint64_t hash = 0xcbf29ce484222325;
+        for (auto ch : str) {
+            hash ^= static_cast<uint8_t>(ch);
+            hash *= 0x100000001b3;
+        }
+        return hash;
+    }
+}
+
+ici::circle_cache::circle_cache(const std::string& dir, uintmax_t max_size) :
+        dir_(dir), max_size_(max_size) {
+}
+
+fs::path ici::circle_cache::file(const std::string& key) const {
+    return dir_ / std::format("{:016x}{}", fnv1a(key), k_extension);
+}
+
+std::optional<std::vector<ici::circle>> ici::circle_cache::find(const std::string& key) const {
+    auto path = file(key);
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return {};
+    }
+    try {
+        if (read_binary<uint64_t>(in) != k_magic || !r::equal(read_binary_vector<char>(in), key)) {
+            return {};
+        }
+        auto circles = read_binary_vector<circle>(in);
+        std::error_code ec;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+        return circles;
+    } catch (const std::runtime_error&) {
+        return {};
+    }
+}
+
+void ici::circle_cache::insert(const std::string& key, const std::vector<circle>& circles) const {
+    fs::create_directories(dir_);
+    auto path = file(key);
+    auto temp = fs::path(path).replace_extension(".tmp");
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        write_binary(out, k_magic);
+        write_binary(out, std::vector<char>(key.begin(), key.end()));
+        write_binary(out, circles);
+        if (!out) {
+            throw std::runtime_error(std::format("unable to write {}", temp.string()));
+        }
+    }
+    fs::rename(temp, path);
+    evict(path);
+}
+
+void ici::circle_cache::evict(const fs::path& keep) const {
+    // a file's modification time is when it was last written or found, so the oldest is
+    // the least recently used.
+    std::vector<std::tuple<fs::file_time_type, uintmax_t, fs::path>> files;
+    uintmax_t total = 0;
+    for (const auto& entry : fs::directory_iterator(dir_)) {
+        if (entry.is_regular_file() && entry.path().extension() == k_extension) {
+            files.emplace_back(entry.last_write_time(), entry.file_size(), entry.path());
+            total += entry.file_size();
+        }
+    }
+    r::sort(files);
+    for (const auto& [time, size, path] : files) {
+        if (total <= max_size_) {
+            break;
+        }
+        if (path != keep) {
+            std::error_code ec;
+            if (fs::remove(path, ec)) {
+                total -= size;
+            }
+        }
+    }
+}
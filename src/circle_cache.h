@@ -0,0 +1,33 @@
+#pragma once
+
+#include "geometry.h"
+#include <filesystem>
+#include <optional>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // a directory of generated circle sets, each in a binary file named by a hash of the
+    // key it was generated for, which the file also records in full. Looking a set up marks
+    // it as recently used, and inserting one evicts the least recently used sets until the
+    // directory is back under its size limit.
+
+    class circle_cache {
+        std::filesystem::path dir_;
+        uintmax_t max_size_;
+
+        std::filesystem::path file(const std::string& key) const;
+        void evict(const std::filesystem::path& keep) const;
+
+    public:
+        circle_cache(const std::string& dir, uintmax_t max_size);
+
+        std::optional<std::vector<circle>> find(const std::string& key) const;
+        void insert(const std::string& key, const std::vector<circle>& circles) const;
+    };
+
+}
@@ -0,0 +1,42 @@
+#include "circle_queue.h"
+
+/*------------------------------------------------------------------------------------------------*/
+
+ici::circle_queue::circle_queue(size_t capacity) : capacity_(capacity), closed_(false) {
+}
+
+void ici::circle_queue::push(std::vector<circle> batch) {
+    {
+        std::unique_lock lock(mutex_);
+        not_full_.wait(lock, [this]() { return closed_ || batches_.size() < capacity_; });
+        if (closed_) {
+            return;
+        }
+        batches_.push_back(std::move(batch));
+    }
+    not_empty_.notify_one();
+}
+
+std::optional<std::vector<ici::circle>> ici::circle_queue::pop() {
+    std::vector<circle> batch;
+    {
+        std::unique_lock lock(mutex_);
+        not_empty_.wait(lock, [this]() { return closed_ || !batches_.empty(); });
+        if (batches_.empty()) {
+            return {};
+        }
+        batch = std::move(batches_.front());
+        batches_.pop_front();
+    }
+    not_full_.notify_one();
+    return batch;
+}
+
+void ici::circle_queue::close() {
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "geometry.h"
+#include <vector>
+#include <deque>
+#include <optional>
+#include <mutex>
+#include <condition_variable>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // a bounded queue of batches of circles between threads. Pushing blocks while the queue
+    // is full, so a producer can never get more than capacity batches ahead of its consumer.
+    // Once closed, popping drains what is left and then returns nothing.
+
+    class circle_queue {
+
+        std::deque<std::vector<circle>> batches_;
+        size_t capacity_;
+        bool closed_;
+        std::mutex mutex_;
+        std::condition_variable not_full_;
+        std::condition_variable not_empty_;
+
+    public:
+        circle_queue(size_t capacity);
+
+        void push(std::vector<circle> batch);
+        std::optional<std::vector<circle>> pop();
+        void close();
+    };
+
+}
@@ -1,6 +1,11 @@
 #include "circle_set.h"
 #include <boost/functional/hash.hpp>
 #include <ranges>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <bit>
 
 namespace r = std::ranges;
 namespace rv = std::ranges::views;
@@ -9,6 +14,54 @@ namespace bgi = boost::geometry::index;
 
 /*------------------------------------------------------------------------------------------------*/
 
+namespace {
+
+    constexpr int k_initial_bits = 4;
+    constexpr size_t k_prefetch_distance = 8;
+    constexpr uint8_t k_empty = 0;
+
+    // when merging near duplicates, the table's grid is this many eps wide, so a coordinate
+    // is within eps of a neighboring cell only when it is in the outer quarter of its own.
+    constexpr double k_near_cell_size = 4.0;
+    constexpr double k_near_cell_margin = 0.5 - 1.0 / k_near_cell_size;
+
+    // which neighboring cell, if any, a coordinate k * v rounded to key is within one grid
+    // step of a quarter of: -1 or 1 for the cell below or above, or 0.
+    int64_t near_side(double v, double k, int64_t key) {
+        auto offset = k * v - static_cast<double>(key);
+        return (offset > k_near_cell_margin) ? 1 : (offset < -k_near_cell_margin) ? -1 : 0;
+    }
+
+    // rounds v, clamped to well inside the range of a key, where a relative grid about a
+    // vanishingly small circle would otherwise send it.
+    int64_t round_clamped(double v) {
+        constexpr double limit = static_cast<double>(int64_t{ 1 } << 62);
+        return static_cast<int64_t>(std::round(std::clamp(v, -limit, limit)));
+    }
+
+    bool within(const ici::circle& a, const ici::circle& b, double eps) {
+        return std::abs(a.loc.x - b.loc.x) < eps &&
+            std::abs(a.loc.y - b.loc.y) < eps &&
+            std::abs(a.radius - b.radius) < eps;
+    }
+
+    // a slot's control byte is empty, or has its top bit set and seven bits of the hash of
+    // the circle in it below that.
+    uint8_t control_byte(uint64_t hash, int bits) {
+        return static_cast<uint8_t>(0x80 | ((hash >> (57 - bits)) & 0x7f));
+    }
+
+    size_t home_slot(uint64_t hash, int bits) {
+        return static_cast<size_t>(hash >> (64 - bits));
+    }
+
+    void prefetch(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(p);
+#endif
+    }
+}
+
 bool ici::circle_set::discretized_circle::operator==(const discretized_circle& c) const
 {
     return x == c.x && y == c.y && r == c.r;
@@ -23,9 +76,33 @@ size_t ici::circle_set::hash_discretized_circle::operator()(const discretized_ci
     return seed;
 }
 
+uint64_t ici::circle_set::partition_hash::operator()(const discretized_circle& c) const
+{
+    uint64_t h = hash_discretized_circle{}(c);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    return h;
+}
+
 ici::circle_set::discretized_circle ici::circle_set::discretize(
         const circle& c) const {
 
+    if (scale_ == tolerance_scale::relative) {
+        // the bits of a positive double increase with its logarithm, so rounding away the
+        // low bits of the mantissa rounds the radius on a logarithmic scale, without a log.
+        auto radius = std::max(c.radius, std::numeric_limits<double>::min());
+        auto bits = std::bit_cast<int64_t>(radius);
+        auto r = (bits + (int64_t{ 1 } << radius_shift_ >> 1)) >> radius_shift_;
+        auto exponent = static_cast<int>((r << radius_shift_) >> 52) - 1023;
+        auto k = 1.0 / eps_;
+        return {
+            round_clamped(k * std::ldexp(c.loc.x, -exponent)),
+            round_clamped(k * std::ldexp(c.loc.y, -exponent)),
+            r
+        };
+    }
+
     auto k = 1.0 / eps_;
 
     return {
@@ -35,29 +112,260 @@ ici::circle_set::discretized_circle ici::circle_set::discretize(
     };
 }
 
-ici::circle_set::circle_set(double eps) : eps_(eps) {
+ici::circle_set::circle_set(double eps, tolerance_scale scale, bool merge_near) : 
+        control_(size_t{ 1 } << k_initial_bits, k_empty),
+        slots_(size_t{ 1 } << k_initial_bits),
+        bits_(k_initial_bits),
+        eps_(eps),
+        scale_(scale),
+        radius_shift_(0),
+        merge_near_(merge_near),
+        near_duplicates_(0) {
+    if (scale == tolerance_scale::relative) {
+        // keep as many bits of the mantissa as it takes for one step of the last to be at
+        // most eps of the radius.
+        auto mantissa_bits = std::clamp(static_cast<int>(std::ceil(-std::log2(eps))), 0, 52);
+        radius_shift_ = 52 - mantissa_bits;
+    }
+    if (merge_near && scale == tolerance_scale::relative) {
+        throw std::runtime_error("near duplicates can only be merged with an absolute tolerance");
+    }
+}
+
+// the key a circle is indexed by in the table: its discretized key, or when merging near
+// duplicates, the cell of the coarser grid it is in.
+ici::circle_set::discretized_circle ici::circle_set::table_key(const circle& c) const {
+    if (!merge_near_) {
+        return discretize(c);
+    }
+    auto k = 1.0 / (k_near_cell_size * eps_);
+    return {
+        static_cast<int64_t>(std::round(k * c.loc.x)),
+        static_cast<int64_t>(std::round(k * c.loc.y)),
+        static_cast<int64_t>(std::round(k * c.radius))
+    };
+}
+
+// the table takes a slot's home from the top bits of the hash and the control byte from the
+// seven below those, so the key hash is spread over the high bits by a Fibonacci multiply.
+uint64_t ici::circle_set::table_hash(const discretized_circle& key) const {
+    uint64_t h = hash_discretized_circle{}(key);
+    return (h ^ (h >> 32)) * 0x9e3779b97f4a7c15;
+}
+
+// the slot holding the circle with the given key, or the empty slot where it would go.
+size_t ici::circle_set::probe(const discretized_circle& key, uint64_t hash) const {
+    auto mask = control_.size() - 1;
+    auto control = control_byte(hash, bits_);
+    for (auto i = home_slot(hash, bits_);; i = (i + 1) & mask) {
+        if (control_[i] == k_empty) {
+            return i;
+        }
+        if (control_[i] == control && discretize(circles_[slots_[i]]) == key) {
+            return i;
+        }
+    }
+}
+
+// the slot holding a circle within eps of c among those in the cell with the given hash, or
+// the empty slot that ends the cell's probe sequence. A cell can hold several circles, and
+// any circle within eps is a match, whichever cell it is in.
+size_t ici::circle_set::probe_near(const circle& c, uint64_t hash) const {
+    auto mask = control_.size() - 1;
+    auto control = control_byte(hash, bits_);
+    for (auto i = home_slot(hash, bits_);; i = (i + 1) & mask) {
+        if (control_[i] == k_empty) {
+            return i;
+        }
+        if (control_[i] == control && within(circles_[slots_[i]], c, eps_)) {
+            return i;
+        }
+    }
+}
+
+// the slot holding a circle within eps of c, looking in its own cell, with the given key,
+// and then in each combination of the neighboring cells it is near, or if there is none,
+// the empty slot in its own cell's probe sequence where it would go.
+size_t ici::circle_set::find_near(const circle& c, const discretized_circle& key,
+        uint64_t hash) const {
+    auto home = probe_near(c, hash);
+    if (control_[home] != k_empty) {
+        return home;
+    }
+    auto k = 1.0 / (k_near_cell_size * eps_);
+    int64_t sides[] = {
+        near_side(c.loc.x, k, key.x), near_side(c.loc.y, k, key.y), near_side(c.radius, k, key.r)
+    };
+    for (int neighbor = 1; neighbor < 8; ++neighbor) {
+        if (((neighbor & 1) && !sides[0]) || ((neighbor & 2) && !sides[1]) ||
+                ((neighbor & 4) && !sides[2])) {
+            continue;
+        }
+        discretized_circle cell{
+            key.x + ((neighbor & 1) ? sides[0] : 0),
+            key.y + ((neighbor & 2) ? sides[1] : 0),
+            key.r + ((neighbor & 4) ? sides[2] : 0)
+        };
+        auto slot = probe_near(c, table_hash(cell));
+        if (control_[slot] != k_empty) {
+            return slot;
+        }
+    }
+    return home;
+}
+
+std::pair<size_t, bool> ici::circle_set::insert(const circle& c, const discretized_circle& key,
+        uint64_t hash) {
+    auto slot = merge_near_ ? find_near(c, key, hash) : probe(key, hash);
+    if (control_[slot] != k_empty) {
+        if (merge_near_ && discretize(circles_[slots_[slot]]) != discretize(c)) {
+            ++near_duplicates_;
+        }
+        return { slots_[slot], false };
+    }
+    if (circles_.size() == std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("too many circles for a circle set");
+    }
+    control_[slot] = control_byte(hash, bits_);
+    slots_[slot] = static_cast<uint32_t>(circles_.size());
+    circles_.push_back(c);
+    return { circles_.size() - 1, true };
+}
+
+void ici::circle_set::rehash(int bits) {
+    bits_ = bits;
+    control_.assign(size_t{ 1 } << bits, k_empty);
+    slots_.assign(size_t{ 1 } << bits, 0);
+    auto mask = control_.size() - 1;
+    for (auto j : rv::iota(size_t{ 0 }, circles_.size())) {
+        auto hash = table_hash(table_key(circles_[j]));
+        auto i = home_slot(hash, bits);
+        while (control_[i] != k_empty) {
+            i = (i + 1) & mask;
+        }
+        control_[i] = control_byte(hash, bits);
+        slots_[i] = static_cast<uint32_t>(j);
+    }
+}
+
+// the table is kept at most seven eighths full.
+void ici::circle_set::reserve(size_t n) {
+    auto bits = bits_;
+    while (n * 8 > (size_t{ 7 } << bits)) {
+        ++bits;
+    }
+    if (bits != bits_) {
+        rehash(bits);
+    }
+}
+
+void ici::circle_set::clear() {
+    circles_.clear();
+    r::fill(control_, k_empty);
+    near_duplicates_ = 0;
+}
+
+void ici::circle_set::replace(size_t i, const circle& c) {
+    circles_.set(i, c);
+}
+
+std::pair<size_t, bool> ici::circle_set::insert(const circle& c) {
+    reserve(circles_.size() + 1);
+    auto key = table_key(c);
+    return insert(c, key, table_hash(key));
+}
+
+void ici::circle_set::insert_batch(const circle_buffer& circles,
+        std::vector<std::pair<size_t, bool>>& results) {
+    auto n = circles.size();
+    reserve(circles_.size() + n);
+
+    std::vector<discretized_circle> keys(n);
+    std::vector<uint64_t> hashes(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = table_key(circles[i]);
+        hashes[i] = table_hash(keys[i]);
+    }
+
+    results.clear();
+    results.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (i + k_prefetch_distance < n) {
+            auto ahead = home_slot(hashes[i + k_prefetch_distance], bits_);
+            prefetch(&control_[ahead]);
+            prefetch(&slots_[ahead]);
+        }
+        results.push_back(insert(circles[i], keys[i], hashes[i]));
+    }
+}
+
+bool ici::circle_set::contains(const circle& c) const {
+    auto key = table_key(c);
+    auto hash = table_hash(key);
+    return control_[merge_near_ ? find_near(c, key, hash) : probe(key, hash)] != k_empty;
+}
+
+std::optional<size_t> ici::circle_set::find(const circle& c) const {
+    auto key = table_key(c);
+    auto hash = table_hash(key);
+    auto slot = merge_near_ ? find_near(c, key, hash) : probe(key, hash);
+    if (control_[slot] == k_empty) {
+        return std::nullopt;
+    }
+    return slots_[slot];
 }
 
-void ici::circle_set::insert(const circle& c) {
-    auto key = discretize(c);
-    if (impl_.contains(key)) {
-        return;
+void ici::circle_set::find_batch(const circle_buffer& circles,
+        std::vector<std::optional<size_t>>& results) const {
+    auto n = circles.size();
+    std::vector<discretized_circle> keys(n);
+    std::vector<uint64_t> hashes(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = table_key(circles[i]);
+        hashes[i] = table_hash(keys[i]);
     }
-    impl_[key] = c;
+
+    results.clear();
+    results.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (i + k_prefetch_distance < n) {
+            auto ahead = home_slot(hashes[i + k_prefetch_distance], bits_);
+            prefetch(&control_[ahead]);
+            prefetch(&slots_[ahead]);
+        }
+        auto slot = merge_near_ ?
+            find_near(circles[i], keys[i], hashes[i]) : probe(keys[i], hashes[i]);
+        results.push_back(control_[slot] == k_empty ?
+            std::nullopt : std::optional<size_t>{ slots_[slot] });
+    }
+}
+
+ici::circle ici::circle_set::operator[](size_t i) const {
+    return circles_[i];
+}
+
+const ici::circle_buffer& ici::circle_set::circles() const {
+    return circles_;
 }
 
 std::vector<ici::circle> ici::circle_set::to_vector() const {
-    return impl_ | rv::values | r::to<std::vector>();
+    return rv::iota(size_t{ 0 }, circles_.size()) | rv::transform(
+            [this](size_t i) { return circles_[i]; }
+        ) | r::to<std::vector>();
 }
 
 double ici::circle_set::eps() const {
     return eps_;
 }
 
+size_t ici::circle_set::near_duplicates() const {
+    return near_duplicates_;
+}
+
 bool ici::circle_set::empty() const {
-    return impl_.empty();
+    return circles_.empty();
 }
 
 size_t ici::circle_set::size() const {
-    return impl_.size();
+    return circles_.size();
 }
@@ -1,7 +1,12 @@
 #pragma once
 
 #include "geometry.h"
+#include "circle_buffer.h"
 #include <memory>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <optional>
 #include <ranges>
 #include <boost/geometry.hpp>
 #include <boost/geometry/index/rtree.hpp>
@@ -12,8 +17,29 @@
 
 namespace ici {
 
-    class circle_set {
+    // an append-only set of circles, deduplicated to within eps. Circles are stored densely
+    // in insertion order and are identified by their index in that order. The index is an
+    // open-addressing table, probed linearly, of the positions of the circles alone: each
+    // slot has a control byte holding seven bits of its circle's hash, and a circle's key is
+    // only recomputed to confirm a match when those agree. That is about seven bytes per
+    // circle over the circle itself.
+    //
+    // Rounding to a grid of size eps separates circles that differ by far less than eps but
+    // round to either side of a grid line. A set that merges near duplicates instead treats
+    // circles as the same when each coordinate differs by less than eps: its table is keyed
+    // by a grid four times coarser, and a circle that is not found in its own cell is looked
+    // for in the neighboring cells it is within eps of, of which there are usually only a
+    // few. Which of several circles within eps of each other is kept then depends on the
+    // order they are inserted in.
+    //
+    // With a relative tolerance, the grid is scaled to each circle instead: the radius is
+    // rounded on a logarithmic scale, to steps of at most eps times itself, and the center to
+    // multiples of eps times the power of two at or below the rounded radius, so huge
+    // circles match as readily as tiny ones are told apart. Merging near duplicates is only
+    // supported with an absolute tolerance.
 
+    class circle_set {
+    public:
         struct discretized_circle {
             int64_t x;
             int64_t y;
@@ -26,22 +52,73 @@ namespace ici {
             size_t operator()(const discretized_circle& c) const;
         };
 
-        discretized_circle discretize(const circle& c) const;
+        // a second hash of a key, independent of the bits of the first that the set's own
+        // table uses, for splitting circles between several sets.
+        struct partition_hash {
+            uint64_t operator()(const discretized_circle& c) const;
+        };
 
-        std::unordered_map<discretized_circle, ici::circle, hash_discretized_circle> impl_;
+    private:
+        circle_buffer circles_;
+        std::vector<uint8_t> control_;
+        std::vector<uint32_t> slots_;
+        int bits_;
         double eps_;
+        tolerance_scale scale_;
+        int radius_shift_;
+        bool merge_near_;
+        size_t near_duplicates_;
+
+        discretized_circle table_key(const circle& c) const;
+        uint64_t table_hash(const discretized_circle& key) const;
+        size_t probe(const discretized_circle& key, uint64_t hash) const;
+        size_t probe_near(const circle& c, uint64_t hash) const;
+        size_t find_near(const circle& c, const discretized_circle& key, uint64_t hash) const;
+        std::pair<size_t, bool> insert(const circle& c, const discretized_circle& key,
+            uint64_t hash);
+        void rehash(int bits);
 
     public:
-        circle_set(double eps);
+        circle_set(double eps, tolerance_scale scale = tolerance_scale::absolute,
+            bool merge_near = false);
         circle_set(double eps, std::ranges::forward_range auto circles) : 
                 circle_set(eps) {
             for (auto&& c : circles) {
                 insert(c);
             }
         }
-        void insert(const circle& c);
+        std::pair<size_t, bool> insert(const circle& c);
+
+        // inserts the circles in order, exactly as inserting them one at a time would, and
+        // sets results to what each insert would have returned. Hashing the whole batch up
+        // front lets each insert prefetch the slots of the ones after it.
+        void insert_batch(const circle_buffer& circles,
+            std::vector<std::pair<size_t, bool>>& results);
+        void reserve(size_t n);
+
+        // empties the set, keeping the capacity of its table for refilling it.
+        void clear();
+
+        // replaces circle i with c, which must have the same key.
+        void replace(size_t i, const circle& c);
+        bool contains(const circle& c) const;
+
+        // the index of the circle in the set that c is a duplicate of, if there is one.
+        std::optional<size_t> find(const circle& c) const;
+
+        // sets results to what find would return for each circle, prefetching slots ahead
+        // the way insert_batch does.
+        void find_batch(const circle_buffer& circles,
+            std::vector<std::optional<size_t>>& results) const;
+        discretized_circle discretize(const circle& c) const;
+        circle operator[](size_t i) const;
+        const circle_buffer& circles() const;
         std::vector<circle> to_vector() const;
         double eps() const;
+
+        // how many inserted circles were merged with a circle that rounds to a different key,
+        // which a set that does not merge near duplicates would have kept as well.
+        size_t near_duplicates() const;
         bool empty() const;
         size_t size() const;
     };
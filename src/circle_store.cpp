@@ -0,0 +1,186 @@
+#include "circle_store.h"
+#include "util.h"
+#include <stdexcept>
+#include <algorithm>
+
+/*------------------------------------------------------------------------------------------------*/
+
+ici::circle_store::circle_store(double eps, const std::vector<circle>& seeds,
+        tolerance_scale scale, bool merge_near) :
+        set_(eps, scale, merge_near),
+        generation_start_{0} {
+    for (const auto& seed : seeds) {
+        insert(seed);
+    }
+}
+
+void ici::circle_store::start_generation() {
+    generation_start_.push_back(set_.size());
+    prev_frontier_ = std::move(curr_frontier_);
+    curr_frontier_ = {};
+}
+
+std::pair<size_t, bool> ici::circle_store::insert(const circle& c, const lineage& parents) {
+    auto gen = generation();
+    auto [index, inserted] = set_.insert(c);
+    if (!inserted) {
+        reproduce(index);
+        return { index, false };
+    }
+    tags_.push_back({ gen, gen });
+    lineages_.push_back(parents);
+    curr_frontier_.push_back(static_cast<uint32_t>(index));
+    return { index, true };
+}
+
+void ici::circle_store::insert_batch(const circle_buffer& circles,
+        std::span<const lineage> parents, std::vector<std::pair<size_t, bool>>& results) {
+    auto gen = generation();
+    set_.insert_batch(circles, results);
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto [index, inserted] = results[i];
+        if (!inserted) {
+            reproduce(index);
+            continue;
+        }
+        tags_.push_back({ gen, gen });
+        lineages_.push_back(parents[i]);
+        curr_frontier_.push_back(static_cast<uint32_t>(index));
+    }
+}
+
+void ici::circle_store::reproduce(size_t i) {
+    // adds a circle already in the store to the current frontier, if it is not there yet.
+    auto gen = generation();
+    if (tags_[i].last == gen) {
+        return;
+    }
+    tags_[i].last = gen;
+    curr_frontier_.push_back(static_cast<uint32_t>(i));
+}
+
+bool ici::circle_store::contains(const circle& c) const {
+    return set_.contains(c);
+}
+
+std::optional<size_t> ici::circle_store::find(const circle& c) const {
+    return set_.find(c);
+}
+
+void ici::circle_store::find_batch(const circle_buffer& circles,
+        std::vector<std::optional<size_t>>& results) const {
+    set_.find_batch(circles, results);
+}
+
+ici::circle_set::discretized_circle ici::circle_store::discretize(const circle& c) const {
+    return set_.discretize(c);
+}
+
+int ici::circle_store::generation() const {
+    return static_cast<int>(generation_start_.size()) - 1;
+}
+
+size_t ici::circle_store::begin(int generation) const {
+    return generation_start_.at(generation);
+}
+
+size_t ici::circle_store::end(int generation) const {
+    return (generation < this->generation()) ?
+        generation_start_.at(generation + 1) :
+        set_.size();
+}
+
+int ici::circle_store::first_generation(size_t i) const {
+    return tags_[i].first;
+}
+
+std::span<const ici::lineage> ici::circle_store::lineages() const {
+    return lineages_;
+}
+
+std::span<const uint32_t> ici::circle_store::previous() const {
+    return prev_frontier_;
+}
+
+std::span<const uint32_t> ici::circle_store::current() const {
+    return curr_frontier_;
+}
+
+ici::circle_buffer ici::circle_store::gather(std::span<const uint32_t> indices) const {
+    circle_buffer buffer;
+    buffer.reserve(indices.size());
+    for (auto i : indices) {
+        buffer.push_back(set_[i]);
+    }
+    return buffer;
+}
+
+ici::circle ici::circle_store::operator[](size_t i) const {
+    return set_[i];
+}
+
+const ici::circle_buffer& ici::circle_store::circles() const {
+    return set_.circles();
+}
+
+size_t ici::circle_store::size() const {
+    return set_.size();
+}
+
+double ici::circle_store::eps() const {
+    return set_.eps();
+}
+
+size_t ici::circle_store::near_duplicates() const {
+    return set_.near_duplicates();
+}
+
+std::vector<ici::circle> ici::circle_store::all_circles() const {
+    return set_.to_vector();
+}
+
+std::vector<ici::circle> ici::circle_store::generated_circles() const {
+    // the circles produced by any generation after the seeds; seeds only count if some
+    // generation reproduced them.
+    std::vector<circle> circles;
+    for (size_t i = 0; i < set_.size(); ++i) {
+        if (tags_[i].last > 0) {
+            circles.push_back(set_[i]);
+        }
+    }
+    return circles;
+}
+
+void ici::circle_store::write(std::ostream& out) const {
+    write_binary(out, all_circles());
+    write_binary(out, tags_);
+    write_binary(out, lineages_);
+    write_binary(out, generation_start_);
+    write_binary(out, prev_frontier_);
+    write_binary(out, curr_frontier_);
+}
+
+ici::circle_store ici::circle_store::read(std::istream& in, double eps, tolerance_scale scale,
+        bool merge_near) {
+    // the circles were distinct when first inserted, so inserting them again in order
+    // rebuilds the set with the same indices.
+    circle_store store(eps, {}, scale, merge_near);
+    for (const auto& c : read_binary_vector<circle>(in)) {
+        store.set_.insert(c);
+    }
+    store.tags_ = read_binary_vector<generation_tag>(in);
+    store.lineages_ = read_binary_vector<lineage>(in);
+    store.generation_start_ = read_binary_vector<size_t>(in);
+    store.prev_frontier_ = read_binary_vector<uint32_t>(in);
+    store.curr_frontier_ = read_binary_vector<uint32_t>(in);
+
+    auto n = store.set_.size();
+    auto in_range = [n](uint32_t i) { return i < n; };
+    if (store.tags_.size() != n || store.lineages_.size() != n ||
+            store.generation_start_.empty() || store.generation_start_.back() > n ||
+            !std::ranges::all_of(store.prev_frontier_, in_range) ||
+            !std::ranges::all_of(store.curr_frontier_, in_range)) {
+        throw std::runtime_error("inconsistent circle store data");
+    }
+    return store;
+}
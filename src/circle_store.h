@@ -0,0 +1,91 @@
+#pragma once
+
+#include "geometry.h"
+#include "circle_set.h"
+#include "circle_buffer.h"
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <limits>
+#include <iostream>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // the two circles a circle was first generated from: it is the image of invertee
+    // inverted about inverter. Seeds have no parents.
+    struct lineage {
+        static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+        uint32_t inverter;
+        uint32_t invertee;
+    };
+
+    // the single store of every circle generated by iterated inversion. Each distinct circle
+    // is stored once, tagged with the generation it first appeared in, so the circles first
+    // seen in generation g occupy the contiguous index range [begin(g), end(g)). A generation
+    // may also reproduce circles first seen earlier, so its frontier, the circles it produced,
+    // is kept as a list of indices into the store. Only the previous and current frontiers
+    // are retained. Every circle also records its lineage.
+
+    class circle_store {
+
+        struct generation_tag {
+            int first;
+            int last;
+        };
+
+        circle_set set_;
+        std::vector<generation_tag> tags_;
+        std::vector<lineage> lineages_;
+        std::vector<size_t> generation_start_;
+        std::vector<uint32_t> prev_frontier_;
+        std::vector<uint32_t> curr_frontier_;
+
+    public:
+        circle_store(double eps, const std::vector<circle>& seeds,
+            tolerance_scale scale = tolerance_scale::absolute, bool merge_near = false);
+
+        void start_generation();
+        // inserts the circle unless the store has it, in which case it is reproduced, and
+        // returns its index and whether it was new.
+        std::pair<size_t, bool> insert(const circle& c,
+            const lineage& parents = { lineage::none, lineage::none });
+
+        // inserts circles with their lineages in order, as insert would one at a time, and
+        // sets results to the index of each and whether it was new.
+        void insert_batch(const circle_buffer& circles, std::span<const lineage> parents,
+            std::vector<std::pair<size_t, bool>>& results);
+        void reproduce(size_t i);
+        bool contains(const circle& c) const;
+        std::optional<size_t> find(const circle& c) const;
+        void find_batch(const circle_buffer& circles,
+            std::vector<std::optional<size_t>>& results) const;
+        circle_set::discretized_circle discretize(const circle& c) const;
+
+        int generation() const;
+        size_t begin(int generation) const;
+        size_t end(int generation) const;
+        int first_generation(size_t i) const;
+        std::span<const lineage> lineages() const;
+
+        std::span<const uint32_t> previous() const;
+        std::span<const uint32_t> current() const;
+        circle_buffer gather(std::span<const uint32_t> indices) const;
+
+        circle operator[](size_t i) const;
+        const circle_buffer& circles() const;
+        size_t size() const;
+        double eps() const;
+        size_t near_duplicates() const;
+
+        std::vector<circle> all_circles() const;
+        std::vector<circle> generated_circles() const;
+
+        void write(std::ostream& out) const;
+        static circle_store read(std::istream& in, double eps, tolerance_scale scale,
+            bool merge_near);
+    };
+
+}
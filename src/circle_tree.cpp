@@ -23,15 +23,19 @@ namespace {
 ici::circle_tree::circle_tree() {
 }
 
-void ici::circle_tree::insert(const ici::circle& c)
+ici::circle_tree::rtree_value ici::circle_tree::to_value(const ici::circle& c, uint32_t id) {
+    return { to_box(bounds(c)), c, id };
+}
+
+void ici::circle_tree::insert(const ici::circle& c, uint32_t id)
 {
-    impl_.insert(rtree_value(to_box(bounds(c)), c));
+    impl_.insert(to_value(c, id));
 }
 
 std::vector<ici::circle> ici::circle_tree::intersects(const ici::rectangle& r) const {
     std::vector<rtree_value> results;
     impl_.query(bgi::intersects(to_box(r)), std::back_inserter(results));
-    return results | rv::values | rv::filter(
+    return results | rv::elements<1> | rv::filter(
             [&](const circle& c) {
                 return ici::circle_rectangle_intersection(c, r);
             }
@@ -41,9 +45,16 @@ std::vector<ici::circle> ici::circle_tree::intersects(const ici::rectangle& r) c
 std::vector<ici::circle> ici::circle_tree::contains(const ici::point& pt) const {
     std::vector<rtree_value> results;
     impl_.query(bgi::intersects(bg::make<vec2>(pt.x,pt.y)), std::back_inserter(results));
-    return results | rv::values | rv::filter(
+    return results | rv::elements<1> | rv::filter(
         [&](const circle& c) {
             return ici::circle_contains_pt(c, pt);
         }
     ) | r::to<std::vector>();
 }
+
+std::vector<uint32_t> ici::circle_tree::intersecting_bounds(const ici::rectangle& r) const {
+    // the ids of the circles whose bounding boxes intersect r, without the exact test.
+    std::vector<rtree_value> results;
+    impl_.query(bgi::intersects(to_box(r)), std::back_inserter(results));
+    return results | rv::elements<2> | r::to<std::vector>();
+}
@@ -7,28 +7,38 @@
 #include <boost/geometry/geometries/register/point.hpp>
 #include <vector>
 #include <ranges>
+#include <tuple>
+#include <cstdint>
 
 namespace ici {
 
     class circle_tree {
         using vec2 = boost::geometry::model::point<double, 2, boost::geometry::cs::cartesian>;
         using box = boost::geometry::model::box<vec2>;
-        using rtree_value = std::pair<box, ici::circle>;
+        using rtree_value = std::tuple<box, ici::circle, uint32_t>;
         using rtree = boost::geometry::index::rtree<rtree_value, boost::geometry::index::quadratic<16>>;
 
         rtree impl_;
 
+        static rtree_value to_value(const ici::circle& c, uint32_t id);
+
     public:
         circle_tree();
+
+        // bulk loads the circles, identifying each by its position in the range.
         circle_tree(std::ranges::forward_range auto circles) {
+            std::vector<rtree_value> values;
+            uint32_t id = 0;
             for (auto&& c : circles) {
-                insert(c);
+                values.push_back(to_value(c, id++));
             }
+            impl_ = rtree(values);
         }
 
-        void insert(const ici::circle& c);
+        void insert(const ici::circle& c, uint32_t id = 0);
         std::vector<ici::circle> intersects(const ici::rectangle& r) const;
         std::vector<ici::circle> contains(const ici::point& pt) const;
+        std::vector<uint32_t> intersecting_bounds(const ici::rectangle& r) const;
     };
 
 }
\ No newline at end of file
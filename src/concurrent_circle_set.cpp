@@ -0,0 +1,73 @@
+#include "concurrent_circle_set.h"
+#include <bit>
+#include <algorithm>
+#include <ranges>
+
+namespace r = std::ranges;
+namespace rv = std::ranges::views;
+
+/*------------------------------------------------------------------------------------------------*/
+
+ici::concurrent_circle_set::shard::shard(double eps, tolerance_scale scale) : set(eps, scale) {
+}
+
+ici::concurrent_circle_set::concurrent_circle_set(double eps, tolerance_scale scale,
+        size_t min_shards) :
+        bits_(std::bit_width(std::max<size_t>(min_shards, 1) - 1)) {
+    for (size_t i = 0; i < (size_t{ 1 } << bits_); ++i) {
+        shards_.push_back(std::make_unique<shard>(eps, scale));
+    }
+}
+
+// the shard is picked by the top bits of the partition hash; a shard's own table indexes its
+// circles by a different hash, so they spread over all of its slots.
+ici::concurrent_circle_set::shard& ici::concurrent_circle_set::shard_for(const circle& c) const {
+    if (bits_ == 0) {
+        return *shards_.front();
+    }
+    auto h = circle_set::partition_hash{}(shards_.front()->set.discretize(c));
+    return *shards_[h >> (64 - bits_)];
+}
+
+bool ici::concurrent_circle_set::insert(const circle& c, uint64_t id) {
+    auto& s = shard_for(c);
+    std::lock_guard lock(s.mutex);
+    auto [index, inserted] = s.set.insert(c);
+    if (inserted) {
+        s.ids.push_back(id);
+    } else if (id < s.ids[index]) {
+        s.set.replace(index, c);
+        s.ids[index] = id;
+    }
+    return inserted;
+}
+
+std::optional<uint64_t> ici::concurrent_circle_set::find(const circle& c) const {
+    const auto& s = shard_for(c);
+    std::lock_guard lock(s.mutex);
+    auto index = s.set.find(c);
+    if (!index) {
+        return std::nullopt;
+    }
+    return s.ids[*index];
+}
+
+void ici::concurrent_circle_set::clear() {
+    for (auto& s : shards_) {
+        std::lock_guard lock(s->mutex);
+        s->set.clear();
+        s->ids.clear();
+    }
+}
+
+std::vector<ici::circle> ici::concurrent_circle_set::snapshot() const {
+    std::vector<std::pair<uint64_t, circle>> tagged;
+    for (const auto& s : shards_) {
+        std::lock_guard lock(s->mutex);
+        for (size_t i = 0; i < s->ids.size(); ++i) {
+            tagged.emplace_back(s->ids[i], s->set[i]);
+        }
+    }
+    r::sort(tagged, {}, [](const auto& t) { return t.first; });
+    return tagged | rv::values | r::to<std::vector>();
+}
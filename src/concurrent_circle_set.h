@@ -0,0 +1,56 @@
+#pragma once
+
+#include "geometry.h"
+#include "circle_set.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // a set of circles, deduplicated to within eps the same way circle_set is, that any
+    // number of threads can insert into at once. A circle's partition hash picks one of many
+    // shards, each a circle_set behind its own lock, so threads only wait for each other
+    // when they insert into the same shard at the same moment. Every circle is inserted with
+    // an id, and of the circles with the same key the set keeps the one with the smallest
+    // id, so once every insert is done what it holds does not depend on the order the
+    // threads ran in. Giving circles their positions in a sequential order as ids makes the
+    // set end up as a circle_set filled in that order would.
+
+    class concurrent_circle_set {
+        struct alignas(64) shard {
+            mutable std::mutex mutex;
+            circle_set set;
+            std::vector<uint64_t> ids;
+
+            shard(double eps, tolerance_scale scale);
+        };
+
+        std::vector<std::unique_ptr<shard>> shards_;
+        int bits_;
+
+        shard& shard_for(const circle& c) const;
+
+    public:
+        // the number of shards is the smallest power of two of at least min_shards.
+        concurrent_circle_set(double eps, tolerance_scale scale, size_t min_shards);
+
+        // inserts the circle unless the set has one with the same key, which it replaces if
+        // id is smaller than that circle's, and returns whether the key was new.
+        bool insert(const circle& c, uint64_t id);
+
+        // the id of the circle in the set with the same key as c, if there is one.
+        std::optional<uint64_t> find(const circle& c) const;
+
+        // empties every shard, keeping its capacity.
+        void clear();
+
+        // the circles in the set in the order of their ids. Not to be called while other
+        // threads insert.
+        std::vector<circle> snapshot() const;
+    };
+
+}
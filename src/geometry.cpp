@@ -1,6 +1,9 @@
 #include "geometry.h"
 #include <complex>
 #include <ranges>
+#include <cmath>
+#include <limits>
+#include <array>
 
 namespace r = std::ranges;
 namespace rv = std::ranges::views;
@@ -14,6 +17,26 @@ namespace {
         return { x,y };
     }
 
+    // inverts invertee about c in closed form. With d the offset of the invertee's center
+    // from the center of inversion and D = |d|^2 - r^2, the image has center c + (R^2/D)*d
+    // and radius R^2*r/|D|. D vanishes when the invertee passes through the center of
+    // inversion, in which case the image is a line and there is no circle to return.
+    bool invert_circle(const ici::circle& c, const ici::circle& invertee, ici::circle& image) {
+        auto dx = invertee.loc.x - c.loc.x;
+        auto dy = invertee.loc.y - c.loc.y;
+        auto dist_squ = dx * dx + dy * dy;
+        auto r_squ = invertee.radius * invertee.radius;
+        auto denom = dist_squ - r_squ;
+        auto k = (c.radius * c.radius) / denom;
+
+        image = {
+            { c.loc.x + k * dx, c.loc.y + k * dy },
+            std::abs(k) * invertee.radius
+        };
+
+        return std::abs(denom) > std::numeric_limits<float>::epsilon() * (dist_squ + r_squ);
+    }
+
     std::array<ici::point, 4> vertices(const ici::rectangle& r) {
         return {
             r.min,
@@ -131,24 +154,11 @@ std::optional<ici::point> ici::invert(const circle& c, const point& pt) {
 
 std::optional<ici::circle> ici::invert(const circle& c, const circle& invertee)
 {
-    std::array<std::optional<point>, 4> ary = { {
-        invert(c, invertee.loc + point{0, invertee.radius}),    //north
-        invert(c, invertee.loc + point{ -invertee.radius, 0 }), //west
-        invert(c, invertee.loc + point{ invertee.radius, 0 }),  //east
-        invert(c, invertee.loc + point{ 0, -invertee.radius })  //south
-    } };
-
-    auto pts = ary | rv::filter(
-        [](auto&& p) { return p.has_value(); }
-    ) | rv::transform(
-        [](auto&& p) { return p.value(); }
-    ) | r::to<std::vector>();
-
-    if (pts.size() < 3) {
+    circle image;
+    if (!invert_circle(c, invertee, image)) {
         return {};
     }
-
-    return circle_through_three_points(pts[0], pts[1], pts[2]);
+    return image;
 }
 
 double ici::distance(const point& pt1, const point& pt2)
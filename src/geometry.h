@@ -25,6 +25,13 @@ namespace ici {
         double radius;
     };
 
+    // how a tolerance eps between circles scales: absolutely, the same for every circle, or
+    // relative to the size of the circles compared.
+    enum class tolerance_scale {
+        absolute,
+        relative
+    };
+
     point operator+(const point& lhs, const point& rhs);
     point operator-(const point& lhs, const point& rhs);
     point operator*(double lhs, const point& rhs);
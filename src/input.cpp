@@ -1,8 +1,11 @@
 #include "input.h"
 #include "third-party/json.hpp"
+#include "thread_pool.h"
+#include "util.h"
 #include <fstream>
 #include <filesystem>
 #include <ranges>
+#include <sstream>
 
 namespace fs = std::filesystem;
 namespace r = std::ranges;
@@ -20,10 +23,40 @@ namespace {
     constexpr auto k_default_aa_level = 0;
     constexpr auto k_default_scale = 100.0;
     constexpr auto k_default_padding = 10.0;
+    constexpr auto k_auto_min_radius_in_pixels = 0.5;
+    constexpr auto k_default_roi_error_in_pixels = 1.0;
+    constexpr auto k_default_auto_stop_in_pixels = 0.5;
+    constexpr auto k_max_auto_iterations = 100;
+    constexpr auto k_default_cache_size_in_mb = 1024;
+    constexpr auto k_default_memory_budget_in_mb = 1024;
 
     constexpr auto k_default_out_fname = "circle_inv.svg"; 
     constexpr auto k_eps_field = "eps";
+    constexpr auto k_tolerance_field = "tolerance";
     constexpr auto k_iters_field = "iterations";
+    constexpr auto k_auto_stop_field = "auto-stop-pixels";
+    constexpr auto k_threads_field = "threads";
+    constexpr auto k_mode_field = "generation-mode";
+    constexpr auto k_scheduler_field = "scheduler";
+    constexpr auto k_worker_processes_field = "worker-processes";
+    constexpr auto k_merge_near_field = "merge-near-duplicates";
+    constexpr auto k_deduplication_field = "deduplication";
+    constexpr auto k_symmetry_field = "symmetry";
+    constexpr auto k_engine_field = "inversion-engine";
+    constexpr auto k_pair_radius_field = "pair-radius-multiple";
+    constexpr auto k_max_circles_field = "max-circles";
+    constexpr auto k_priority_field = "priority";
+    constexpr auto k_min_radius_field = "min-radius";
+    constexpr auto k_auto = "auto";
+    constexpr auto k_roi_field = "region-of-interest";
+    constexpr auto k_roi_error_field = "roi-error-pixels";
+    constexpr auto k_roi_pruning_field = "roi-pruning";
+    constexpr auto k_streaming_field = "streaming";
+    constexpr auto k_checkpoint_field = "checkpoint-dir";
+    constexpr auto k_cache_field = "cache-dir";
+    constexpr auto k_cache_size_field = "cache-size-mb";
+    constexpr auto k_scratch_field = "scratch-dir";
+    constexpr auto k_memory_budget_field = "memory-budget-mb";
     constexpr auto k_output_res_field = "resolution";
     constexpr auto k_antialias_field = "antialiasing-level";
     constexpr auto k_colors_field = "colors";
@@ -80,13 +113,202 @@ namespace {
         return json[k_eps_field].get<double>();
     }
 
+    ici::tolerance_scale get_tolerance(const json& json) {
+        if (!json.contains(k_tolerance_field)) {
+            return ici::tolerance_scale::absolute;
+        }
+        auto tolerance = json[k_tolerance_field].get<std::string>();
+        if (tolerance == "absolute") {
+            return ici::tolerance_scale::absolute;
+        }
+        if (tolerance != "relative") {
+            throw std::runtime_error(std::format("unknown tolerance '{}'", tolerance));
+        }
+        return ici::tolerance_scale::relative;
+    }
+
     int get_num_iterations(const json& json) {
         if (!json.contains(k_iters_field)) {
             return k_epsilon;
         }
+        if (json[k_iters_field].is_string()) {
+            return k_max_auto_iterations;
+        }
         return json[k_iters_field].get<int>();
     }
 
+    int get_num_threads(const json& json) {
+        if (!json.contains(k_threads_field)) {
+            return ici::default_thread_count();
+        }
+        auto threads = json[k_threads_field].get<int>();
+        return (threads > 0) ? threads : ici::default_thread_count();
+    }
+
+    ici::generation_mode get_generation_mode(const json& json) {
+        if (!json.contains(k_mode_field)) {
+            return ici::generation_mode::frontier;
+        }
+        auto mode = json[k_mode_field].get<std::string>();
+        if (mode == "frontier") {
+            return ici::generation_mode::frontier;
+        }
+        if (mode == "closure") {
+            return ici::generation_mode::closure;
+        }
+        if (mode == "depth-first") {
+            return ici::generation_mode::depth_first;
+        }
+        if (mode == "out-of-core") {
+            return ici::generation_mode::out_of_core;
+        }
+        throw std::runtime_error(std::format("unknown generation mode '{}'", mode));
+    }
+
+    bool get_symmetry(const json& json) {
+        if (!json.contains(k_symmetry_field)) {
+            return true;
+        }
+        return json[k_symmetry_field].get<bool>();
+    }
+
+    ici::inversion_engine get_inversion_engine(const json& json) {
+        if (!json.contains(k_engine_field)) {
+            return ici::inversion_engine::circles;
+        }
+        auto engine = json[k_engine_field].get<std::string>();
+        if (engine == "circles") {
+            return ici::inversion_engine::circles;
+        }
+        if (engine == "mobius") {
+            return ici::inversion_engine::mobius;
+        }
+        throw std::runtime_error(std::format("unknown inversion engine '{}'", engine));
+    }
+
+    double get_pair_radius_multiple(const json& json) {
+        if (!json.contains(k_pair_radius_field)) {
+            return 0.0;
+        }
+        auto k = json[k_pair_radius_field].get<double>();
+        if (k <= 1.0) {
+            throw std::runtime_error("pair-radius-multiple must be greater than 1");
+        }
+        return k;
+    }
+
+    size_t get_max_circles(const json& json) {
+        if (!json.contains(k_max_circles_field)) {
+            return 0;
+        }
+        auto max_circles = json[k_max_circles_field].get<int64_t>();
+        return (max_circles > 0) ? static_cast<size_t>(max_circles) : 0;
+    }
+
+    ici::generation_scheduler get_scheduler(const json& json) {
+        if (!json.contains(k_scheduler_field)) {
+            return ici::generation_scheduler::rounds;
+        }
+        auto scheduler = json[k_scheduler_field].get<std::string>();
+        if (scheduler == "rounds") {
+            return ici::generation_scheduler::rounds;
+        }
+        if (scheduler != "dataflow") {
+            throw std::runtime_error(std::format("unknown scheduler '{}'", scheduler));
+        }
+        if (get_generation_mode(json) != ici::generation_mode::closure) {
+            throw std::runtime_error("the dataflow scheduler requires closure generation mode");
+        }
+        if (get_pair_radius_multiple(json) > 0.0 || get_max_circles(json) > 0) {
+            throw std::runtime_error(
+                "the dataflow scheduler cannot be combined with pair-radius-multiple or max-circles"
+            );
+        }
+        return ici::generation_scheduler::dataflow;
+    }
+
+    int get_worker_processes(const json& json) {
+        if (!json.contains(k_worker_processes_field)) {
+            return 0;
+        }
+        auto processes = json[k_worker_processes_field].get<int>();
+        if (processes <= 0) {
+            throw std::runtime_error("worker-processes must be positive");
+        }
+        if (get_generation_mode(json) != ici::generation_mode::closure ||
+                get_scheduler(json) != ici::generation_scheduler::rounds) {
+            throw std::runtime_error(
+                "worker processes require closure generation mode with the rounds scheduler"
+            );
+        }
+        if (get_inversion_engine(json) != ici::inversion_engine::circles ||
+                get_pair_radius_multiple(json) > 0.0 || get_max_circles(json) > 0) {
+            throw std::runtime_error(
+                "worker processes cannot be combined with the mobius engine, pair-radius-multiple or max-circles"
+            );
+        }
+        return processes;
+    }
+
+    bool get_merge_near_duplicates(const json& json) {
+        if (!json.contains(k_merge_near_field) || !json[k_merge_near_field].get<bool>()) {
+            return false;
+        }
+        auto mode = get_generation_mode(json);
+        if ((mode != ici::generation_mode::frontier && mode != ici::generation_mode::closure) ||
+                get_worker_processes(json) > 0) {
+            throw std::runtime_error(
+                "merge-near-duplicates requires frontier or closure mode without worker processes"
+            );
+        }
+        if (get_tolerance(json) != ici::tolerance_scale::absolute) {
+            throw std::runtime_error("merge-near-duplicates requires an absolute tolerance");
+        }
+        return true;
+    }
+
+    ici::deduplication_strategy get_deduplication(const json& json) {
+        if (!json.contains(k_deduplication_field)) {
+            return ici::deduplication_strategy::hash;
+        }
+        auto strategy = json[k_deduplication_field].get<std::string>();
+        if (strategy == "hash") {
+            return ici::deduplication_strategy::hash;
+        }
+        if (strategy != "sort") {
+            throw std::runtime_error(std::format("unknown deduplication '{}'", strategy));
+        }
+        auto mode = get_generation_mode(json);
+        if ((mode != ici::generation_mode::frontier && mode != ici::generation_mode::closure) ||
+                get_scheduler(json) != ici::generation_scheduler::rounds ||
+                get_worker_processes(json) > 0 || get_max_circles(json) > 0 ||
+                get_merge_near_duplicates(json)) {
+            throw std::runtime_error(
+                "sort deduplication requires frontier or closure mode with the rounds scheduler, no worker processes, no max-circles and no merge-near-duplicates"
+            );
+        }
+        return ici::deduplication_strategy::sort;
+    }
+
+    ici::budget_priority get_budget_priority(const json& json,
+            const std::variant<ici::vector_settings, ici::raster_settings>& output_settings) {
+        if (!json.contains(k_priority_field)) {
+            return ici::budget_priority::largest;
+        }
+        auto priority = json[k_priority_field].get<std::string>();
+        if (priority == "largest") {
+            return ici::budget_priority::largest;
+        }
+        if (priority != "closest-to-view") {
+            throw std::runtime_error(std::format("unknown priority '{}'", priority));
+        }
+        auto raster = std::get_if<ici::raster_settings>(&output_settings);
+        if (!raster || !raster->view) {
+            throw std::runtime_error("closest-to-view priority requires raster output with a view");
+        }
+        return ici::budget_priority::closest_to_view;
+    }
+
     std::string get_out_file(const json& json, const std::string& inp_file) {
         auto input_dir = fs::path(inp_file).parent_path();
         if (!json.contains(k_out_file)) {
@@ -195,6 +417,190 @@ namespace {
         return *get_vector_output_settings(outfile, json);
     }
 
+    // the width of a pixel in logical units given the raster view, or the bounds of the seeds
+    // if there is no view, and the output resolution.
+    double pixel_size(const ici::raster_settings& raster, const std::vector<ici::circle>& seeds) {
+        auto view = raster.view ? *raster.view : ici::bounds(seeds);
+        auto extent = std::max(view.max.x - view.min.x, view.max.y - view.min.y);
+        return extent / raster.resolution;
+    }
+
+    // a min-radius of "auto" culls circles less than half a pixel in radius, i.e. too small
+    // to cover a pixel.
+    double get_min_radius(const json& json, const std::vector<ici::circle>& seeds,
+            const std::variant<ici::vector_settings, ici::raster_settings>& output_settings) {
+        if (!json.contains(k_min_radius_field)) {
+            return 0.0;
+        }
+        const auto& min_radius = json[k_min_radius_field];
+        if (!min_radius.is_string()) {
+            return min_radius.get<double>();
+        }
+        if (min_radius.get<std::string>() != k_auto) {
+            throw std::runtime_error("min-radius must be a number or \"auto\"");
+        }
+        if (!std::holds_alternative<ici::raster_settings>(output_settings)) {
+            throw std::runtime_error("\"auto\" min-radius requires raster output");
+        }
+        return k_auto_min_radius_in_pixels * 
+            pixel_size(std::get<ici::raster_settings>(output_settings), seeds);
+    }
+
+    // "auto" iterations stop once the largest new circle in the view is smaller than a
+    // fraction of a pixel, up to a fixed maximum number of iterations.
+    std::optional<ici::adaptive_stop> get_adaptive_stop(const json& json, 
+            const std::vector<ici::circle>& seeds, ici::generation_mode mode,
+            const std::variant<ici::vector_settings, ici::raster_settings>& output_settings) {
+        if (!json.contains(k_iters_field) || !json[k_iters_field].is_string()) {
+            return {};
+        }
+        if (json[k_iters_field].get<std::string>() != k_auto) {
+            throw std::runtime_error("iterations must be a number or \"auto\"");
+        }
+        const auto* raster = std::get_if<ici::raster_settings>(&output_settings);
+        if (!raster) {
+            throw std::runtime_error("\"auto\" iterations requires raster output");
+        }
+        if (mode == ici::generation_mode::depth_first) {
+            throw std::runtime_error("\"auto\" iterations does not apply to depth-first mode");
+        }
+        if (get_max_circles(json) > 0) {
+            throw std::runtime_error("\"auto\" iterations cannot be combined with max-circles");
+        }
+        auto stop_in_pixels = json.contains(k_auto_stop_field) ?
+            json[k_auto_stop_field].get<double>() :
+            k_default_auto_stop_in_pixels;
+        return ici::adaptive_stop{
+            raster->view ? *raster->view : ici::bounds(seeds),
+            stop_in_pixels * pixel_size(*raster, seeds)
+        };
+    }
+
+    ici::roi_pruning get_roi_pruning(const json& json) {
+        if (!json.contains(k_roi_pruning_field)) {
+            return ici::roi_pruning::conservative;
+        }
+        auto pruning = json[k_roi_pruning_field].get<std::string>();
+        if (pruning == "conservative") {
+            return ici::roi_pruning::conservative;
+        }
+        if (pruning != "heuristic") {
+            throw std::runtime_error(std::format("unknown roi-pruning '{}'", pruning));
+        }
+        return ici::roi_pruning::heuristic;
+    }
+
+    std::optional<ici::region_of_interest> get_region_of_interest(const json& json,
+            const std::vector<ici::circle>& seeds,
+            const std::variant<ici::vector_settings, ici::raster_settings>& output_settings) {
+        if (!json.contains(k_roi_field) || !json[k_roi_field].get<bool>()) {
+            return {};
+        }
+        const auto* raster = std::get_if<ici::raster_settings>(&output_settings);
+        if (!raster || !raster->view) {
+            throw std::runtime_error("region-of-interest requires raster output with a view");
+        }
+        auto error_in_pixels = json.contains(k_roi_error_field) ?
+            json[k_roi_error_field].get<double>() :
+            k_default_roi_error_in_pixels;
+        return ici::region_of_interest{
+            *raster->view,
+            error_in_pixels * pixel_size(*raster, seeds),
+            get_roi_pruning(json)
+        };
+    }
+
+    bool get_streaming(const json& json,
+            const std::variant<ici::vector_settings, ici::raster_settings>& output_settings) {
+        if (!json.contains(k_streaming_field) || !json[k_streaming_field].get<bool>()) {
+            return false;
+        }
+        const auto* raster = std::get_if<ici::raster_settings>(&output_settings);
+        if (!raster || !raster->view) {
+            throw std::runtime_error("streaming requires raster output with a view");
+        }
+        return true;
+    }
+
+    // a relative directory is taken to be relative to the input file's.
+    std::string get_checkpoint_dir(const json& json, const std::string& inp_file) {
+        if (!json.contains(k_checkpoint_field)) {
+            return {};
+        }
+        auto mode = get_generation_mode(json);
+        if (mode == ici::generation_mode::depth_first || mode == ici::generation_mode::out_of_core ||
+                get_scheduler(json) == ici::generation_scheduler::dataflow ||
+                get_max_circles(json) > 0 || get_worker_processes(json) > 0) {
+            throw std::runtime_error(
+                "checkpoints require frontier or closure mode with the rounds scheduler, no max-circles and no worker processes"
+            );
+        }
+        auto dir = fs::path(json[k_checkpoint_field].get<std::string>());
+        return dir.is_absolute() ? dir.string() : (fs::path(inp_file).parent_path() / dir).string();
+    }
+
+    std::string get_cache_dir(const json& json, const std::string& inp_file) {
+        if (!json.contains(k_cache_field)) {
+            return {};
+        }
+        if (json.contains(k_streaming_field) && json[k_streaming_field].get<bool>()) {
+            throw std::runtime_error("cache-dir cannot be combined with streaming");
+        }
+        auto dir = fs::path(json[k_cache_field].get<std::string>());
+        return dir.is_absolute() ? dir.string() : (fs::path(inp_file).parent_path() / dir).string();
+    }
+
+    uintmax_t get_cache_size(const json& json) {
+        auto mb = json.contains(k_cache_size_field) ?
+            json[k_cache_size_field].get<double>() :
+            k_default_cache_size_in_mb;
+        if (mb <= 0.0) {
+            throw std::runtime_error("cache-size-mb must be positive");
+        }
+        return static_cast<uintmax_t>(mb * 1024 * 1024);
+    }
+
+    // a relative directory is taken to be relative to the input file's, and the default is
+    // the system's temporary directory.
+    std::string get_scratch_dir(const json& json, const std::string& inp_file) {
+        if (get_generation_mode(json) != ici::generation_mode::out_of_core) {
+            if (json.contains(k_scratch_field)) {
+                throw std::runtime_error("scratch-dir requires out-of-core generation mode");
+            }
+            return {};
+        }
+        if (!json.contains(k_scratch_field)) {
+            return fs::temp_directory_path().string();
+        }
+        auto dir = fs::path(json[k_scratch_field].get<std::string>());
+        return dir.is_absolute() ? dir.string() : (fs::path(inp_file).parent_path() / dir).string();
+    }
+
+    uintmax_t get_memory_budget(const json& json) {
+        if (get_generation_mode(json) != ici::generation_mode::out_of_core) {
+            if (json.contains(k_memory_budget_field)) {
+                throw std::runtime_error("memory-budget-mb requires out-of-core generation mode");
+            }
+            return 0;
+        }
+        if (get_inversion_engine(json) != ici::inversion_engine::circles ||
+                get_pair_radius_multiple(json) > 0.0 || get_max_circles(json) > 0) {
+            throw std::runtime_error(
+                "out-of-core generation cannot be combined with the mobius engine, pair-radius-multiple or max-circles"
+            );
+        }
+        if (!json.contains(k_streaming_field) || !json[k_streaming_field].get<bool>()) {
+            throw std::runtime_error("out-of-core generation requires streaming");
+        }
+        auto mb = json.contains(k_memory_budget_field) ?
+            json[k_memory_budget_field].get<double>() :
+            k_default_memory_budget_in_mb;
+        if (mb <= 0.0) {
+            throw std::runtime_error("memory-budget-mb must be positive");
+        }
+        return static_cast<uintmax_t>(mb * 1024 * 1024);
+    }
+
     std::expected<const ici::input, std::runtime_error> json_to_input(
             const std::string& inp_file, const json& json) {
 
@@ -211,16 +617,41 @@ namespace {
         }
 
         auto outp = get_out_file(json, inp_file);
+        auto circles = json_to_circles(
+            json["circles"].get<std::vector<::json>>()
+        );
+        auto output_settings = get_output_settings(outp, json);
 
         return ici::input{
             .fname = fs::path(inp_file).filename().string(),
-            .circles = json_to_circles( 
-                json["circles"].get<std::vector<::json>>()
-            ),
+            .circles = circles,
             .eps = get_eps( json ),
+            .tolerance = get_tolerance( json ),
             .iterations = get_num_iterations( json ),
+            .auto_stop = get_adaptive_stop( 
+                json, circles, get_generation_mode( json ), output_settings 
+            ),
+            .threads = get_num_threads( json ),
+            .mode = get_generation_mode( json ),
+            .scheduler = get_scheduler( json ),
+            .worker_processes = get_worker_processes( json ),
+            .merge_near_duplicates = get_merge_near_duplicates( json ),
+            .deduplication = get_deduplication( json ),
+            .symmetry = get_symmetry( json ),
+            .engine = get_inversion_engine( json ),
+            .pair_radius_multiple = get_pair_radius_multiple( json ),
+            .max_circles = get_max_circles( json ),
+            .priority = get_budget_priority( json, output_settings ),
+            .min_radius = get_min_radius( json, circles, output_settings ),
+            .roi = get_region_of_interest( json, circles, output_settings ),
+            .streaming = get_streaming( json, output_settings ),
+            .checkpoint_dir = get_checkpoint_dir( json, inp_file ),
+            .cache_dir = get_cache_dir( json, inp_file ),
+            .cache_size = get_cache_size( json ),
+            .scratch_dir = get_scratch_dir( json, inp_file ),
+            .memory_budget = get_memory_budget( json ),
             .out_file = outp,
-            .output_settings = get_output_settings(outp, json)
+            .output_settings = output_settings
         };
     }
 }
@@ -239,3 +670,39 @@ std::expected<const ici::input, std::runtime_error> ici::parse_input(const std::
         return std::unexpected(std::runtime_error("unknown error while parsing input"));
     }
 }
+
+std::string ici::generation_key(const input& inp, bool include_iterations) {
+    std::ostringstream key;
+    write_binary(key, inp.circles);
+    write_binary(key, inp.eps);
+    write_binary(key, inp.tolerance);
+    write_binary(key, inp.mode);
+    write_binary(key, inp.merge_near_duplicates);
+    write_binary(key, inp.symmetry);
+    // worker processes use neither symmetry nor lineage, and each shard keeps the first of
+    // the circles with a key in an order that depends on the number of workers, so circles
+    // generated with a different number of them, or in process, can differ by rounding.
+    write_binary(key, inp.worker_processes);
+    write_binary(key, inp.engine);
+    write_binary(key, inp.pair_radius_multiple);
+    write_binary(key, inp.max_circles);
+    write_binary(key, inp.priority);
+    if (inp.max_circles > 0 && inp.priority == budget_priority::closest_to_view) {
+        write_binary(key, *std::get<raster_settings>(inp.output_settings).view);
+    }
+    write_binary(key, inp.min_radius);
+    write_binary(key, inp.roi.has_value());
+    if (inp.roi) {
+        write_binary(key, inp.roi->view);
+        write_binary(key, inp.roi->error);
+        write_binary(key, inp.roi->pruning);
+    }
+    if (include_iterations) {
+        write_binary(key, inp.iterations);
+        write_binary(key, inp.auto_stop.has_value());
+        if (inp.auto_stop) {
+            write_binary(key, *inp.auto_stop);
+        }
+    }
+    return key.str();
+}
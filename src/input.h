@@ -31,15 +31,98 @@ namespace ici {
         std::string blend_mode;
     };
 
+    // how images are pruned for a region of interest: only those inside an inverter that
+    // is, like their invertee, off the view and smaller than the error bound, or, by the
+    // heuristic, every image that is not near the view. Neither bounds the descendants of
+    // what it prunes, so both can lose visible circles; the first rarely does.
+    enum class roi_pruning {
+        conservative,
+        heuristic
+    };
+
+    // restricts generation to the circles that can matter to a raster view: images that
+    // pruning judges unlikely to matter to it are not expanded.
+    struct region_of_interest {
+        rectangle view;
+        double error;
+        roi_pruning pruning;
+    };
+
+    // ends generation after the first iteration whose largest new circle intersecting the
+    // view has a radius less than radius, or that adds no new circles at all.
+    struct adaptive_stop {
+        rectangle view;
+        double radius;
+    };
+
+    enum class generation_mode {
+        frontier,
+        closure,
+        depth_first,
+        out_of_core
+    };
+
+    // how closure generation is scheduled: in lock-step iterations, or with each circle's
+    // pairs handed to the thread pool as soon as the circle is found.
+    enum class generation_scheduler {
+        rounds,
+        dataflow
+    };
+
+    // how images are computed: from the coordinates of the two circles, or as products of
+    // the Möbius transformations that take the seeds to them.
+    enum class inversion_engine {
+        circles,
+        mobius
+    };
+
+    // how a generation's images are deduplicated: hashed into the store a batch at a time,
+    // or all sorted together by key.
+    enum class deduplication_strategy {
+        hash,
+        sort
+    };
+
+    // the order circles are generated in when there is a budget.
+    enum class budget_priority {
+        largest,
+        closest_to_view
+    };
+
     struct input {
         std::string fname;
         std::vector<circle> circles;
         double eps;
+        tolerance_scale tolerance;
         int iterations;
+        std::optional<adaptive_stop> auto_stop;
+        int threads;
+        generation_mode mode;
+        generation_scheduler scheduler;
+        int worker_processes;
+        bool merge_near_duplicates;
+        deduplication_strategy deduplication;
+        bool symmetry;
+        inversion_engine engine;
+        double pair_radius_multiple;
+        size_t max_circles;
+        budget_priority priority;
+        double min_radius;
+        std::optional<region_of_interest> roi;
+        bool streaming;
+        std::string checkpoint_dir;
+        std::string cache_dir;
+        uintmax_t cache_size;
+        std::string scratch_dir;
+        uintmax_t memory_budget;
         std::string out_file;
         std::variant<vector_settings, raster_settings> output_settings;
     };
 
     std::expected<const input, std::runtime_error> parse_input(const std::string& inp_file);
 
+    // the seeds and every setting that changes the circles generated from them, serialized,
+    // optionally leaving out the settings that only say how many iterations to run.
+    std::string generation_key(const input& inp, bool include_iterations);
+
 }
\ No newline at end of file
@@ -0,0 +1,428 @@
+#include "inversion_kernel.h"
+#include <cmath>
+#include <limits>
+#include <bit>
+#include <ranges>
+#include <vector>
+#include <print>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ICI_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#define ICI_TARGET(isa)
+#else
+#define ICI_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    // The kernels below all evaluate the closed form used by ici::invert(circle, circle):
+    // with d the offset of the invertee's center from the inverting circle's center and
+    // D = |d|^2 - r^2, the image is centered at center + (R^2/D)*d with radius R^2*r/|D|,
+    // and is a line rather than a circle when |D| is negligible. Every kernel inverts
+    // either n invertees about one fixed circle or one fixed invertee about n circles,
+    // writes the non-degenerate images contiguously to out_x, out_y, out_r, along with the
+    // position of each one's source circle to out_src, and returns how many it wrote. They
+    // use only multiplies, adds and divides, no FMA, so every instruction set produces
+    // bitwise identical circles.
+    //
+    // Images with a radius below min_radius are culled too, tested as R^2*r < min_radius*|D|
+    // so that no division is needed to reject them, and the number of images skipped as
+    // lines is added to lines. This file is compiled without floating-point contraction,
+    // since targeting avx-512 enables FMA and the compiler would otherwise fuse them. That
+    // is checked once, before the first use of a kernel, because a different rounding would
+    // change which circles deduplicate, and a kernel that fails the check is replaced by the
+    // scalar one.
+
+    constexpr double k_degeneracy_tolerance = std::numeric_limits<float>::epsilon();
+
+    using kernel_fn = size_t(*)(const ici::circle& fixed, double min_radius,
+        const double* x, const double* y, const double* r, size_t n,
+        double* out_x, double* out_y, double* out_r, uint32_t* out_src, size_t& lines);
+
+    template<bool fixed_is_inverter>
+    size_t invert_scalar(const ici::circle& fixed, double min_radius,
+            const double* x, const double* y, const double* r, size_t n,
+            double* out_x, double* out_y, double* out_r, uint32_t* out_src, size_t& lines) {
+
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            auto inv_x = fixed_is_inverter ? fixed.loc.x : x[i];
+            auto inv_y = fixed_is_inverter ? fixed.loc.y : y[i];
+            auto inv_r = fixed_is_inverter ? fixed.radius : r[i];
+            auto dx = fixed_is_inverter ? x[i] - fixed.loc.x : fixed.loc.x - x[i];
+            auto dy = fixed_is_inverter ? y[i] - fixed.loc.y : fixed.loc.y - y[i];
+            auto rad = fixed_is_inverter ? r[i] : fixed.radius;
+
+            auto dist_squ = dx * dx + dy * dy;
+            auto r_squ = rad * rad;
+            auto denom = dist_squ - r_squ;
+            auto inv_r_squ = inv_r * inv_r;
+            auto k = inv_r_squ / denom;
+            auto abs_denom = std::abs(denom);
+
+            out_x[count] = inv_x + k * dx;
+            out_y[count] = inv_y + k * dy;
+            out_r[count] = std::abs(k) * rad;
+            out_src[count] = static_cast<uint32_t>(i);
+            auto is_circle = abs_denom > k_degeneracy_tolerance * (dist_squ + r_squ);
+            count += is_circle & (inv_r_squ * rad >= min_radius * abs_denom);
+            lines += !is_circle;
+        }
+        return count;
+    }
+
+#ifdef ICI_X86_64
+
+    // finishes the circles from position i on, past the last full SIMD vector.
+    template<bool fixed_is_inverter>
+    size_t invert_tail(const ici::circle& fixed, double min_radius,
+            const double* x, const double* y, const double* r, size_t n, size_t i,
+            double* out_x, double* out_y, double* out_r, uint32_t* out_src, size_t& lines) {
+        auto count = invert_scalar<fixed_is_inverter>(
+            fixed, min_radius, x + i, y + i, r + i, n - i, out_x, out_y, out_r, out_src, lines
+        );
+        for (size_t j = 0; j < count; ++j) {
+            out_src[j] += static_cast<uint32_t>(i);
+        }
+        return count;
+    }
+
+    template<bool fixed_is_inverter>
+    ICI_TARGET("avx2")
+    size_t invert_avx2(const ici::circle& fixed, double min_radius,
+            const double* x, const double* y, const double* r, size_t n,
+            double* out_x, double* out_y, double* out_r, uint32_t* out_src, size_t& lines) {
+
+        auto fixed_x = _mm256_set1_pd(fixed.loc.x);
+        auto fixed_y = _mm256_set1_pd(fixed.loc.y);
+        auto fixed_r = _mm256_set1_pd(fixed.radius);
+        auto sign_bit = _mm256_set1_pd(-0.0);
+        auto tolerance = _mm256_set1_pd(k_degeneracy_tolerance);
+        auto min_r = _mm256_set1_pd(min_radius);
+
+        size_t count = 0;
+        size_t i = 0;
+        alignas(32) double img_x[4];
+        alignas(32) double img_y[4];
+        alignas(32) double img_r[4];
+
+        for (; i + 4 <= n; i += 4) {
+            auto vx = _mm256_loadu_pd(x + i);
+            auto vy = _mm256_loadu_pd(y + i);
+            auto vr = _mm256_loadu_pd(r + i);
+
+            auto inv_x = fixed_is_inverter ? fixed_x : vx;
+            auto inv_y = fixed_is_inverter ? fixed_y : vy;
+            auto inv_r = fixed_is_inverter ? fixed_r : vr;
+            auto dx = fixed_is_inverter ? _mm256_sub_pd(vx, fixed_x) : _mm256_sub_pd(fixed_x, vx);
+            auto dy = fixed_is_inverter ? _mm256_sub_pd(vy, fixed_y) : _mm256_sub_pd(fixed_y, vy);
+            auto rad = fixed_is_inverter ? vr : fixed_r;
+
+            auto dist_squ = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+            auto r_squ = _mm256_mul_pd(rad, rad);
+            auto denom = _mm256_sub_pd(dist_squ, r_squ);
+            auto inv_r_squ = _mm256_mul_pd(inv_r, inv_r);
+            auto k = _mm256_div_pd(inv_r_squ, denom);
+            auto abs_denom = _mm256_andnot_pd(sign_bit, denom);
+
+            _mm256_store_pd(img_x, _mm256_add_pd(inv_x, _mm256_mul_pd(k, dx)));
+            _mm256_store_pd(img_y, _mm256_add_pd(inv_y, _mm256_mul_pd(k, dy)));
+            _mm256_store_pd(img_r, _mm256_mul_pd(_mm256_andnot_pd(sign_bit, k), rad));
+
+            auto is_circle = _mm256_cmp_pd(
+                abs_denom,
+                _mm256_mul_pd(tolerance, _mm256_add_pd(dist_squ, r_squ)),
+                _CMP_GT_OQ
+            );
+            auto valid = _mm256_and_pd(
+                is_circle,
+                _mm256_cmp_pd(
+                    _mm256_mul_pd(inv_r_squ, rad), _mm256_mul_pd(min_r, abs_denom), _CMP_GE_OQ
+                )
+            );
+            lines += 4 - std::popcount(static_cast<unsigned>(_mm256_movemask_pd(is_circle)));
+            auto mask = static_cast<unsigned>(_mm256_movemask_pd(valid));
+            while (mask) {
+                auto lane = std::countr_zero(mask);
+                out_x[count] = img_x[lane];
+                out_y[count] = img_y[lane];
+                out_r[count] = img_r[lane];
+                out_src[count] = static_cast<uint32_t>(i + lane);
+                ++count;
+                mask &= mask - 1;
+            }
+        }
+
+        return count + invert_tail<fixed_is_inverter>(
+            fixed, min_radius, x, y, r, n, i,
+            out_x + count, out_y + count, out_r + count, out_src + count, lines
+        );
+    }
+
+    template<bool fixed_is_inverter>
+    ICI_TARGET("avx512f")
+    size_t invert_avx512(const ici::circle& fixed, double min_radius,
+            const double* x, const double* y, const double* r, size_t n,
+            double* out_x, double* out_y, double* out_r, uint32_t* out_src, size_t& lines) {
+
+        auto fixed_x = _mm512_set1_pd(fixed.loc.x);
+        auto fixed_y = _mm512_set1_pd(fixed.loc.y);
+        auto fixed_r = _mm512_set1_pd(fixed.radius);
+        auto tolerance = _mm512_set1_pd(k_degeneracy_tolerance);
+        auto min_r = _mm512_set1_pd(min_radius);
+        auto lanes = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+
+        size_t count = 0;
+        size_t i = 0;
+
+        for (; i + 8 <= n; i += 8) {
+            auto vx = _mm512_loadu_pd(x + i);
+            auto vy = _mm512_loadu_pd(y + i);
+            auto vr = _mm512_loadu_pd(r + i);
+
+            auto inv_x = fixed_is_inverter ? fixed_x : vx;
+            auto inv_y = fixed_is_inverter ? fixed_y : vy;
+            auto inv_r = fixed_is_inverter ? fixed_r : vr;
+            auto dx = fixed_is_inverter ? _mm512_sub_pd(vx, fixed_x) : _mm512_sub_pd(fixed_x, vx);
+            auto dy = fixed_is_inverter ? _mm512_sub_pd(vy, fixed_y) : _mm512_sub_pd(fixed_y, vy);
+            auto rad = fixed_is_inverter ? vr : fixed_r;
+
+            auto dist_squ = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+            auto r_squ = _mm512_mul_pd(rad, rad);
+            auto denom = _mm512_sub_pd(dist_squ, r_squ);
+            auto inv_r_squ = _mm512_mul_pd(inv_r, inv_r);
+            auto k = _mm512_div_pd(inv_r_squ, denom);
+            auto abs_denom = _mm512_abs_pd(denom);
+
+            auto is_circle = _mm512_cmp_pd_mask(
+                abs_denom,
+                _mm512_mul_pd(tolerance, _mm512_add_pd(dist_squ, r_squ)),
+                _CMP_GT_OQ
+            );
+            auto valid = is_circle & _mm512_cmp_pd_mask(
+                _mm512_mul_pd(inv_r_squ, rad), _mm512_mul_pd(min_r, abs_denom), _CMP_GE_OQ
+            );
+            lines += 8 - std::popcount(static_cast<unsigned>(is_circle));
+
+            _mm512_mask_compressstoreu_pd(
+                out_x + count, valid, _mm512_add_pd(inv_x, _mm512_mul_pd(k, dx))
+            );
+            _mm512_mask_compressstoreu_pd(
+                out_y + count, valid, _mm512_add_pd(inv_y, _mm512_mul_pd(k, dy))
+            );
+            _mm512_mask_compressstoreu_pd(
+                out_r + count, valid, _mm512_mul_pd(_mm512_abs_pd(k), rad)
+            );
+            // the compressed indices are stored as a full vector; lanes past the valid ones
+            // land in slots that later images overwrite, and never past position i + 8.
+            auto src = _mm512_add_epi64(_mm512_set1_epi64(static_cast<long long>(i)), lanes);
+            _mm256_storeu_si256(
+                reinterpret_cast<__m256i*>(out_src + count),
+                _mm512_cvtepi64_epi32(_mm512_maskz_compress_epi64(valid, src))
+            );
+            count += std::popcount(static_cast<unsigned>(valid));
+        }
+
+        return count + invert_tail<fixed_is_inverter>(
+            fixed, min_radius, x, y, r, n, i,
+            out_x + count, out_y + count, out_r + count, out_src + count, lines
+        );
+    }
+
+    bool os_saves_registers(unsigned long long xcr0_mask) {
+#if defined(_MSC_VER)
+        return (_xgetbv(0) & xcr0_mask) == xcr0_mask;
+#else
+        unsigned eax = 0;
+        unsigned edx = 0;
+        __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        auto xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+        return (xcr0 & xcr0_mask) == xcr0_mask;
+#endif
+    }
+
+    ici::simd_level query_cpu() {
+#if defined(_MSC_VER)
+        int regs[4] = {};
+        __cpuid(regs, 0);
+        if (regs[0] < 7) {
+            return ici::simd_level::scalar;
+        }
+        __cpuid(regs, 1);
+        bool osxsave = (regs[2] & (1 << 27)) != 0;
+        __cpuidex(regs, 7, 0);
+        bool avx2 = (regs[1] & (1 << 5)) != 0;
+        bool avx512f = (regs[1] & (1 << 16)) != 0;
+#else
+        unsigned eax = 0;
+        unsigned ebx = 0;
+        unsigned ecx = 0;
+        unsigned edx = 0;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return ici::simd_level::scalar;
+        }
+        bool osxsave = (ecx & (1u << 27)) != 0;
+        __builtin_cpu_init();
+        bool avx2 = __builtin_cpu_supports("avx2");
+        bool avx512f = __builtin_cpu_supports("avx512f");
+#endif
+        // the ymm state (bits 1,2) and, for avx-512, the opmask and zmm state (bits 5-7)
+        // must be enabled by the OS, which can only be asked with xgetbv if it sets osxsave.
+        if (!osxsave || !os_saves_registers(0x6)) {
+            return ici::simd_level::scalar;
+        }
+        if (avx512f && os_saves_registers(0xE6)) {
+            return ici::simd_level::avx512;
+        }
+        return avx2 ? ici::simd_level::avx2 : ici::simd_level::scalar;
+    }
+
+#endif
+
+    // circles of widely varying position and size, a count that leaves a tail past the last
+    // full vector of any width, from a fixed linear congruential sequence.
+    ici::circle_buffer sample_circles() {
+        constexpr size_t n = 1021;
+        uint64_t state = 0x9e3779b97f4a7c15;
+        auto next = [&state]() {
+            state = state * 6364136223846793005 + 1442695040888963407;
+            return static_cast<double>(state >> 11) / static_cast<double>(uint64_t{ 1 } << 53);
+        };
+        ici::circle_buffer circles;
+        for (size_t i = 0; i < n; ++i) {
+            auto scale = std::ldexp(1.0, static_cast<int>(next() * 20.0) - 10);
+            auto x = scale * (next() - 0.5);
+            auto y = scale * (next() - 0.5);
+            circles.push_back({ { x, y }, scale * next() });
+        }
+        return circles;
+    }
+
+    // whether kernel writes exactly the bits the scalar kernel does for the sample circles.
+    template<bool fixed_is_inverter>
+    bool matches_scalar(kernel_fn kernel) {
+        static const auto circles = sample_circles();
+        auto n = circles.size();
+        std::vector<double> expected(3 * n);
+        std::vector<double> actual(3 * n);
+        std::vector<uint32_t> expected_src(n);
+        std::vector<uint32_t> actual_src(n);
+        auto run = [&](kernel_fn k, const ici::circle& fixed, std::vector<double>& out,
+                std::vector<uint32_t>& src, size_t& lines) {
+            return k(fixed, 1e-3, circles.x(), circles.y(), circles.r(), n,
+                out.data(), out.data() + n, out.data() + 2 * n, src.data(), lines);
+        };
+        for (size_t i = 0; i < n; i += 97) {
+            size_t expected_lines = 0;
+            size_t actual_lines = 0;
+            auto count = run(invert_scalar<fixed_is_inverter>, circles[i], expected, expected_src,
+                expected_lines);
+            if (run(kernel, circles[i], actual, actual_src, actual_lines) != count ||
+                    actual_lines != expected_lines) {
+                return false;
+            }
+            for (size_t j = 0; j < count; ++j) {
+                for (size_t k = 0; k < 3; ++k) {
+                    if (std::bit_cast<uint64_t>(actual[k * n + j]) !=
+                            std::bit_cast<uint64_t>(expected[k * n + j])) {
+                        return false;
+                    }
+                }
+                if (actual_src[j] != expected_src[j]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    template<bool fixed_is_inverter>
+    kernel_fn select_kernel() {
+        kernel_fn kernel = invert_scalar<fixed_is_inverter>;
+#ifdef ICI_X86_64
+        switch (ici::detect_simd_level()) {
+            case ici::simd_level::avx512:
+                kernel = invert_avx512<fixed_is_inverter>;
+                break;
+            case ici::simd_level::avx2:
+                kernel = invert_avx2<fixed_is_inverter>;
+                break;
+            default:
+                break;
+        }
+#endif
+        if (!matches_scalar<fixed_is_inverter>(kernel)) {
+            std::println(
+                "the {} inversion kernel rounds differently from the scalar one, so the scalar "
+                "one is used; inversion_kernel.cpp must be compiled with -ffp-contract=off.",
+                ici::to_string(ici::detect_simd_level())
+            );
+            return invert_scalar<fixed_is_inverter>;
+        }
+        return kernel;
+    }
+
+    size_t run_kernel(kernel_fn kernel, const ici::circle& fixed,
+            const ici::circle_buffer& circles, size_t begin, size_t end, double min_radius,
+            ici::circle_buffer& output, std::vector<uint32_t>& sources) {
+        auto offset = output.size();
+        output.resize(offset + (end - begin));
+        sources.resize(offset + (end - begin));
+        size_t lines = 0;
+        auto count = kernel(fixed, min_radius,
+            circles.x() + begin, circles.y() + begin, circles.r() + begin, end - begin,
+            output.x() + offset, output.y() + offset, output.r() + offset, sources.data() + offset,
+            lines
+        );
+        output.resize(offset + count);
+        sources.resize(offset + count);
+        for (auto& src : sources | std::views::drop(offset)) {
+            src += static_cast<uint32_t>(begin);
+        }
+        return lines;
+    }
+}
+
+ici::simd_level ici::detect_simd_level() {
+#ifdef ICI_X86_64
+    static const auto level = query_cpu();
+    return level;
+#else
+    return simd_level::scalar;
+#endif
+}
+
+std::string ici::to_string(simd_level level) {
+    switch (level) {
+        case simd_level::avx512:
+            return "avx-512";
+        case simd_level::avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+size_t ici::invert(const circle& c, const circle_buffer& invertees, size_t begin, size_t end,
+        double min_radius, circle_buffer& output, std::vector<uint32_t>& sources) {
+    static const auto kernel = select_kernel<true>();
+    return run_kernel(kernel, c, invertees, begin, end, min_radius, output, sources);
+}
+
+size_t ici::invert(const circle_buffer& circles, size_t begin, size_t end,
+        const circle& invertee, double min_radius, circle_buffer& output,
+        std::vector<uint32_t>& sources) {
+    static const auto kernel = select_kernel<false>();
+    return run_kernel(kernel, invertee, circles, begin, end, min_radius, output, sources);
+}
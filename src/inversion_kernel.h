@@ -0,0 +1,34 @@
+#pragma once
+
+#include "geometry.h"
+#include "circle_buffer.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    enum class simd_level {
+        scalar,
+        avx2,
+        avx512
+    };
+
+    simd_level detect_simd_level();
+    std::string to_string(simd_level level);
+
+    // batch circle inversion over structure-of-arrays circles, using the widest SIMD
+    // instruction set the CPU supports. Images that are lines rather than circles are
+    // skipped, so these append at most end - begin circles to output. For each image
+    // appended, sources receives the index in [begin, end) of the circle it came from.
+    // Images with a radius less than min_radius are skipped too; these return how many of
+    // the skipped images were lines, and the rest were culled for their radius.
+
+    size_t invert(const circle& c, const circle_buffer& invertees, size_t begin, size_t end,
+        double min_radius, circle_buffer& output, std::vector<uint32_t>& sources);
+    size_t invert(const circle_buffer& circles, size_t begin, size_t end, const circle& invertee,
+        double min_radius, circle_buffer& output, std::vector<uint32_t>& sources);
+
+}
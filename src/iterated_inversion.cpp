@@ -1,16 +1,35 @@
 #include "iterated_inversion.h"
 #include "geometry.h"
-#include "circle_set.h"
+#include "circle_store.h"
 #include "circle_tree.h"
 #include "input.h"
 #include "util.h"
 #include "image.h"
+#include "thread_pool.h"
+#include "circle_buffer.h"
+#include "inversion_kernel.h"
+#include "symmetry.h"
+#include "mobius.h"
+#include "candidate_queue.h"
+#include "circle_set.h"
+#include "concurrent_circle_set.h"
+#include "circle_queue.h"
+#include "checkpoint.h"
+#include "out_of_core.h"
+#include "sharded_generation.h"
+#include "bulk_dedup.h"
 #include <print>
 #include <sstream>
 #include <ranges>
 #include <complex>
 #include <filesystem>
 #include <bit>
+#include <functional>
+#include <future>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
 
 namespace fs = std::filesystem;
 namespace r = std::ranges;
@@ -233,75 +252,1611 @@ namespace {
         }
     }
 
-    void invert_and_insert(ici::circle_set& set, const ici::circle& lhs, const ici::circle& rhs) {
-        auto inversion = ici::invert(lhs, rhs);
-        if (inversion) {
-            set.insert(*inversion);
+    // coverage counts at antialiasing sample points, kept modulo the number of colors since
+    // that is all a sample's color depends on. A circle adds to the counts independently of
+    // every other circle, so circles can be stamped one at a time, in any order, as they are
+    // generated, rather than rasterized from a complete set.
+    class coverage {
+        ici::rectangle view_;
+        double spacing_;
+        int dimension_;
+        int cols_;
+        int rows_;
+        uint16_t modulus_;
+        std::vector<uint16_t> counts_;
+
+        double sample(double origin, int i) const {
+            return origin + (i + 0.5) * spacing_;
+        }
+
+        // the sample nearest v along an axis of n samples, clamped to just outside them.
+        int nearest_sample(double origin, double v, int n) const {
+            return static_cast<int>(
+                std::clamp(std::round((v - origin) / spacing_ - 0.5), -1.0, static_cast<double>(n))
+            );
+        }
+
+    public:
+        coverage(const ici::rectangle& view, const ici::raster_settings& settings) :
+                view_(view),
+                dimension_(two_to_the_nth(settings.antialiasing_level)),
+                modulus_(static_cast<uint16_t>(settings.color_tbl.size())) {
+            auto [cols, rows, img_to_log] = image_metrics(view.min, view.max, settings.resolution);
+            cols_ = cols * dimension_;
+            rows_ = rows * dimension_;
+            spacing_ = img_to_log / dimension_;
+            counts_.resize(static_cast<size_t>(cols_) * rows_, 0);
+        }
+
+        void add(const ici::circle& c) {
+            auto first_row = std::max(0, nearest_sample(view_.min.y, c.loc.y - c.radius, rows_));
+            auto last_row = std::min(rows_ - 1, nearest_sample(view_.min.y, c.loc.y + c.radius, rows_));
+            for (auto y = first_row; y <= last_row; ++y) {
+                auto sy = sample(view_.min.y, y);
+                auto dy = sy - c.loc.y;
+                auto half_chord = std::sqrt(std::max(0.0, c.radius * c.radius - dy * dy));
+                auto inside = [&](int x) {
+                    return ici::circle_contains_pt(c, { sample(view_.min.x, x), sy });
+                };
+
+                // the chord gives the span of covered samples up to rounding, which the
+                // exact containment test then settles at either end.
+                auto lo = std::max(0, nearest_sample(view_.min.x, c.loc.x - half_chord, cols_));
+                auto hi = std::min(cols_ - 1, nearest_sample(view_.min.x, c.loc.x + half_chord, cols_));
+                while (lo <= hi && !inside(lo)) {
+                    ++lo;
+                }
+                while (hi >= lo && !inside(hi)) {
+                    --hi;
+                }
+                if (lo > hi) {
+                    continue;
+                }
+                while (lo > 0 && inside(lo - 1)) {
+                    --lo;
+                }
+                while (hi < cols_ - 1 && inside(hi + 1)) {
+                    ++hi;
+                }
+
+                auto* row = counts_.data() + static_cast<size_t>(y) * cols_;
+                for (auto x = lo; x <= hi; ++x) {
+                    if (++row[x] == modulus_) {
+                        row[x] = 0;
+                    }
+                }
+            }
+        }
+
+        ici::image to_image(const std::vector<ici::color>& colors) const {
+            ici::image img(cols_ / dimension_, rows_ / dimension_);
+            auto area = static_cast<double>(dimension_ * dimension_);
+            for (int row = 0; row < img.rows(); ++row) {
+                for (int col = 0; col < img.cols(); ++col) {
+                    double red = 0;
+                    double green = 0;
+                    double blue = 0;
+                    for (int j = 0; j < dimension_; ++j) {
+                        for (int i = 0; i < dimension_; ++i) {
+                            auto y = row * dimension_ + j;
+                            auto x = col * dimension_ + i;
+                            const auto& color = colors[counts_[static_cast<size_t>(y) * cols_ + x]];
+                            red += color.r;
+                            green += color.g;
+                            blue += color.b;
+                        }
+                    }
+                    img(col, row) = to_pixel({
+                        static_cast<uint8_t>(std::round(red / area)),
+                        static_cast<uint8_t>(std::round(green / area)),
+                        static_cast<uint8_t>(std::round(blue / area))
+                    });
+                }
+            }
+            return img;
+        }
+    };
+
+    constexpr size_t k_pairs_per_chunk = 4096;
+    constexpr size_t k_chunks_per_thread = 4;
+
+    // a contiguous range of the circles in a circle buffer, with the index in the store of
+    // each circle in the buffer, or no indices if the buffer is the store's own.
+    struct circle_range {
+        const ici::circle_buffer& circles;
+        size_t begin;
+        size_t end;
+        std::span<const uint32_t> ids;
+
+        size_t size() const {
+            return end - begin;
+        }
+
+        uint32_t id(size_t i) const {
+            return ids.empty() ? static_cast<uint32_t>(i) : ids[i];
+        }
+    };
+
+    circle_range whole(const ici::circle_buffer& circles, std::span<const uint32_t> ids) {
+        return { circles, 0, circles.size(), ids };
+    }
+
+    // the output of inverting one chunk of pairs: the images with the lineage of each, and
+    // the store indices of images that were known from lineage and so were not computed.
+    struct inversion_batch {
+        ici::circle_buffer circles;
+        std::vector<ici::lineage> lineages;
+        std::vector<uint32_t> known;
+        std::vector<uint32_t> sources;
+        std::vector<ici::circle_word> words;
+        ici::word_buffer partner_words;
+        ici::circle_buffer neighbors;
+        std::vector<uint32_t> neighbor_ids;
+        size_t pairs = 0;
+        size_t culled = 0;
+        size_t lines = 0;
+
+        void clear() {
+            circles.clear();
+            lineages.clear();
+            known.clear();
+            sources.clear();
+            words.clear();
+            pairs = 0;
+            culled = 0;
+            lines = 0;
+        }
+    };
+
+    struct generation_counts {
+        size_t pairs = 0;
+        size_t known = 0;
+        size_t culled = 0;
+        size_t lines = 0;
+        double skipped_radius = 0.0;
+
+        generation_counts& operator+=(const generation_counts& counts) {
+            pairs += counts.pairs;
+            known += counts.known;
+            culled += counts.culled;
+            lines += counts.lines;
+            skipped_radius = std::max(skipped_radius, counts.skipped_radius);
+            return *this;
+        }
+    };
+
+    struct generation_context {
+        ici::thread_pool& pool;
+        ici::circle_store& store;
+        double min_radius;
+        std::optional<ici::region_of_interest> roi;
+        std::optional<ici::adaptive_stop> auto_stop;
+        const ici::symmetry_group& symmetry;
+        double pair_radius_multiple;
+
+        // with the Möbius engine, the word of each circle in the store, over the seeds.
+        std::span<const ici::circle> seeds;
+        ici::word_buffer* words;
+
+        // when generating within a budget, where images wait before they are accepted.
+        ici::candidate_queue* candidates;
+
+        // when streaming, where closure generation passes each generation once complete.
+        const ici::circle_sink* sink;
+
+        // where the state is saved after each iteration, if anywhere.
+        const ici::checkpointer* checkpoints;
+
+        // whether a generation's images are deduplicated all at once by sorting them, rather
+        // than hashed into the store a wave at a time.
+        bool sort_images;
+
+        // how the store tells circles apart, which the sets that find a wave's new circles
+        // must match. A store that merges near duplicates is filled a chunk at a time.
+        ici::tolerance_scale tolerance;
+        bool merge_near;
+    };
+
+    // under a symmetry a circle stands for its whole orbit, which satisfies a predicate
+    // like being in a region if any circle of it does.
+    template<typename F>
+    bool any_in_orbit(const generation_context& ctxt, const ici::circle& c, F pred) {
+        if (ctxt.symmetry.trivial()) {
+            return pred(c);
         }
+        return r::any_of(ctxt.symmetry.orbit(c), pred);
+    }
+
+    // whether a circle reaches the view or is at least as large as the error bound.
+    bool matters_to_view(const ici::region_of_interest& roi, const ici::circle& c) {
+        return c.radius >= roi.error || ici::circle_rectangle_intersection(c, roi.view);
     }
 
-    ici::circle_set all_inversions(const ici::circle_set& set) {
-        ici::circle_set output(set.eps());
-        auto circles = set.to_vector();
-        for (const auto& [c1, c2] : ici::two_combinations(circles)) {
-            invert_and_insert(output, c1, c2);
-            invert_and_insert(output, c2, c1);
+    // the heuristic: circles farther than their own radius from the view are taken to have
+    // no visible descendants, as are circles off the view and smaller than the error bound.
+    bool near_view(const ici::region_of_interest& roi, const ici::circle& c) {
+        if (ici::circle_rectangle_intersection(c, roi.view)) {
+            return true;
         }
-        return output;
+        return c.radius >= roi.error &&
+            ici::circle_rectangle_intersection(c, ici::pad(roi.view, c.radius));
+    }
+
+    // an invertee whose disk does not overlap the inverter's is inverted into the inverter's
+    // disk, so when the inverter and the invertee are both off the view and smaller than the
+    // error bound, so is their image; only such images are pruned, and every other one is
+    // kept wherever it lies. That bounds the image but not its descendants, which a large
+    // circle whose boundary it is near can invert into the view, so this too is a heuristic,
+    // if a cautious one. any_copy(c, pred) is whether pred holds for c or, under a symmetry,
+    // for any circle of its orbit.
+    template<typename F>
+    bool image_in_region(const ici::region_of_interest& roi, const ici::circle& inverter,
+            const ici::circle& invertee, const ici::circle& image, F any_copy) {
+        if (roi.pruning == ici::roi_pruning::heuristic) {
+            return any_copy(image, [&](const ici::circle& c) { return near_view(roi, c); });
+        }
+        auto matters = [&](const ici::circle& c) { return matters_to_view(roi, c); };
+        auto outside = ici::distance(inverter.loc, invertee.loc) >= inverter.radius + invertee.radius;
+        return !outside || any_copy(inverter, matters) || any_copy(invertee, matters);
     }
 
-    ici::circle_set inverse_of_cartesian_product(
-            const ici::circle_set& lhs, const ici::circle_set& rhs) {
+    bool orbit_in_region(const generation_context& ctxt, const ici::circle& inverter,
+            const ici::circle& invertee, const ici::circle& image) {
+        return image_in_region(*ctxt.roi, inverter, invertee, image,
+            [&](const ici::circle& c, auto pred) { return any_in_orbit(ctxt, c, pred); }
+        );
+    }
 
-        ici::circle_set output(lhs.eps());
+    // replaces images from position first on with their representatives in the fundamental
+    // domain of the symmetry group.
+    void canonicalize(inversion_batch& out, size_t first, const generation_context& ctxt) {
+        for (auto i = first; i < out.circles.size(); ++i) {
+            out.circles.set(i, ctxt.symmetry.canonical(out.circles[i], ctxt.store.eps()));
+        }
+    }
 
-        if (lhs.empty() || rhs.empty()) {
-            return output;
+    // removes images from position first on that are outside the region of interest, given
+    // the circle lhs that they were inverted about, or the inverter of, and the circles rhs
+    // that their sources index.
+    template<bool lhs_is_inverter>
+    void cull_to_region(inversion_batch& out, size_t first, const generation_context& ctxt,
+            const ici::circle& lhs, const circle_range& rhs) {
+        auto kept = first;
+        for (auto i = first; i < out.circles.size(); ++i) {
+            auto c = out.circles[i];
+            auto other = rhs.circles[out.sources[i]];
+            if (lhs_is_inverter ?
+                    orbit_in_region(ctxt, lhs, other, c) : orbit_in_region(ctxt, other, lhs, c)) {
+                out.circles.set(kept, c);
+                if (!out.words.empty()) {
+                    out.words[kept] = out.words[i];
+                }
+                out.sources[kept++] = out.sources[i];
+            }
+        }
+        out.culled += out.circles.size() - kept;
+        out.circles.resize(kept);
+        out.sources.resize(kept);
+        if (!out.words.empty()) {
+            out.words.resize(kept);
         }
+    }
 
-        auto lhs_circles = lhs.to_vector();
-        auto rhs_circles = rhs.to_vector();
-        for (const auto& [c1, c2] : rv::cartesian_product(lhs_circles, rhs_circles)) {
-            invert_and_insert(output, c1, c2);
-            invert_and_insert(output, c2, c1);
+    // the Möbius engine's counterpart of the inversion kernel, computing images of the
+    // circles of rhs in [from, to) and lhs as products of their words' transforms.
+    template<bool lhs_is_inverter>
+    size_t invert_words(inversion_batch& out, const generation_context& ctxt, uint32_t lhs_id,
+            const circle_range& rhs, size_t from, size_t to) {
+        const auto& words = *ctxt.words;
+        out.partner_words.clear();
+        for (auto j = from; j < to; ++j) {
+            out.partner_words.push_back(words, rhs.id(j));
         }
+        if constexpr (lhs_is_inverter) {
+            return ici::invert(words.inversion(lhs_id), out.partner_words, ctxt.seeds,
+                ctxt.min_radius, from, out.words, out.circles, out.sources);
+        } else {
+            return ici::invert(out.partner_words, words[lhs_id], ctxt.seeds, ctxt.min_radius,
+                from, out.words, out.circles, out.sources);
+        }
+    }
 
-        return output;
+    using pair_range_fn = std::function<void(size_t, size_t, inversion_batch&)>;
+
+    // inverts lhs about the circles of rhs in [begin, end) if lhs_is_inverter, otherwise
+    // inverts those circles about lhs, culling images smaller than the minimum radius, 
+    // which the kernel predicts from the radii and center distance alone, and images
+    // outside the region of interest. known_image(j) returns the store index of the image
+    // of the pair with rhs circle j if lineage already determines it, and lineage::none if
+    // not; such pairs are skipped and their images recorded as known.
+    template<bool lhs_is_inverter, typename F>
+    void invert_run(inversion_batch& out, const generation_context& ctxt, const ici::circle& lhs, 
+            uint32_t lhs_id, const circle_range& rhs, size_t begin, size_t end, F known_image) {
+
+        auto invert_segment = [&](size_t from, size_t to) {
+            if (from == to) {
+                return;
+            }
+            auto first = out.circles.size();
+            size_t lines = 0;
+            if (ctxt.words) {
+                lines = invert_words<lhs_is_inverter>(out, ctxt, lhs_id, rhs, from, to);
+            } else if constexpr (lhs_is_inverter) {
+                lines = ici::invert(lhs, rhs.circles, from, to, ctxt.min_radius,
+                    out.circles, out.sources);
+            } else {
+                lines = ici::invert(rhs.circles, from, to, lhs, ctxt.min_radius,
+                    out.circles, out.sources);
+            }
+            out.lines += lines;
+            out.culled += (to - from) - (out.circles.size() - first) - lines;
+            if (!ctxt.symmetry.trivial()) {
+                canonicalize(out, first, ctxt);
+            }
+            if (ctxt.roi) {
+                cull_to_region<lhs_is_inverter>(out, first, ctxt, lhs, rhs);
+            }
+            for (auto src : out.sources | rv::drop(first)) {
+                out.lineages.push_back(lhs_is_inverter ?
+                    ici::lineage{ lhs_id, rhs.id(src) } :
+                    ici::lineage{ rhs.id(src), lhs_id }
+                );
+            }
+        };
+
+        auto segment_start = begin;
+        for (auto j = begin; j < end; ++j) {
+            auto known = known_image(j);
+            if (known != ici::lineage::none) {
+                invert_segment(segment_start, j);
+                out.known.push_back(known);
+                segment_start = j + 1;
+            }
+        }
+        invert_segment(segment_start, end);
+    }
+
+    // under a symmetry group the circles are representatives of orbits, and the pair of x
+    // and b stands for x paired with every image of b or, equivalently, every image of x
+    // paired with b. Starting from first_element skips the group elements whose pairs are
+    // covered elsewhere. The images are canonicalized, so lineage describes a pair only up
+    // to symmetry and no pairs are answered from it.
+    void invert_under_symmetry(inversion_batch& out, const generation_context& ctxt,
+            const ici::circle& x, uint32_t x_id, const circle_range& rhs, size_t begin,
+            size_t end, size_t first_element) {
+        auto unknown = [](size_t) { return ici::lineage::none; };
+        for (auto g : rv::iota(first_element, ctxt.symmetry.size())) {
+            auto x_g = ctxt.symmetry.apply(g, x);
+            invert_run<true>(out, ctxt, x_g, x_id, rhs, begin, end, unknown);
+            invert_run<false>(out, ctxt, x_g, x_id, rhs, begin, end, unknown);
+        }
+    }
+
+    // inverts lhs about each circle of rhs in [begin, end) and each of those circles about
+    // lhs. Inversion is an involution, so if y is the image of b inverted about x then y
+    // inverted about x is b again; pairs like that are answered from the lineage of y.
+    void invert_both_ways(inversion_batch& out, const generation_context& ctxt, 
+            std::span<const ici::lineage> lineages, const circle_range& lhs, size_t i, 
+            const circle_range& rhs, size_t begin, size_t end) {
+        auto x = lhs.circles[i];
+        auto x_id = lhs.id(i);
+        if (!ctxt.symmetry.trivial()) {
+            invert_under_symmetry(out, ctxt, x, x_id, rhs, begin, end, 0);
+            return;
+        }
+
+        auto x_lineage = lineages[x_id];
+
+        invert_run<true>(out, ctxt, x, x_id, rhs, begin, end,
+            [&](size_t j) {
+                const auto& y_lineage = lineages[rhs.id(j)];
+                return (y_lineage.inverter == x_id) ? y_lineage.invertee : ici::lineage::none;
+            }
+        );
+        invert_run<false>(out, ctxt, x, x_id, rhs, begin, end,
+            [&](size_t j) {
+                return (x_lineage.inverter == rhs.id(j)) ? x_lineage.invertee : ici::lineage::none;
+            }
+        );
+    }
+
+    void accept(generation_context& ctxt, const ici::candidate_queue::candidate& cand) {
+        auto n = ctxt.store.size();
+        ctxt.store.insert(cand.c, cand.parents);
+        if (ctxt.words && ctxt.store.size() > n) {
+            ctxt.words->push_back(*cand.word, ctxt.seeds);
+        }
+    }
+
+    // moves one chunk's images into the candidate queue when generating within a budget, or
+    // otherwise into the store, in order.
+    void merge_batch(generation_context& ctxt, const inversion_batch& batch,
+            generation_counts& counts) {
+        if (ctxt.candidates) {
+            for (size_t i = 0; i < batch.circles.size(); ++i) {
+                auto word = ctxt.words ? 
+                    std::optional<ici::circle_word>{ batch.words[i] } : std::nullopt;
+                auto c = batch.circles[i];
+                if (ctxt.candidates->admits(c) && !ctxt.store.contains(c)) {
+                    ctxt.candidates->push({ c, batch.lineages[i], word });
+                }
+            }
+        } else {
+            std::vector<std::pair<size_t, bool>> inserted;
+            ctxt.store.insert_batch(batch.circles, batch.lineages, inserted);
+            for (size_t i = 0; ctxt.words && i < inserted.size(); ++i) {
+                if (inserted[i].second) {
+                    ctxt.words->push_back(batch.words[i], ctxt.seeds);
+                }
+            }
+        }
+        for (auto known : batch.known) {
+            ctxt.store.reproduce(known);
+        }
+        counts.pairs += batch.pairs;
+        counts.known += batch.known.size();
+        counts.culled += batch.culled;
+        counts.lines += batch.lines;
+    }
+
+    constexpr size_t k_merge_shards_per_thread = 16;
+
+    // the id of image i of chunk b of a wave in the set of the wave's new circles, which
+    // orders the images as merging the chunks in order would.
+    uint64_t image_id(size_t b, size_t i) {
+        return (static_cast<uint64_t>(b) << 32) | i;
+    }
+
+    // what merging a wave through shards works in, kept from one wave to the next so the
+    // shards' tables and the buffers keep their capacity. For each chunk of the wave and
+    // each of its images, stored is the store index of the circle it duplicates if the
+    // store has it, and firsts the id of the first image of its circle in the wave if not.
+    struct wave_merge {
+        ici::concurrent_circle_set fresh;
+        std::vector<std::vector<std::optional<size_t>>> stored;
+        std::vector<std::vector<uint64_t>> firsts;
+
+        wave_merge(const generation_context& ctxt, size_t wave_sz) :
+            fresh(ctxt.store.eps(), ctxt.tolerance,
+                static_cast<size_t>(ctxt.pool.size()) * k_merge_shards_per_thread),
+            stored(wave_sz),
+            firsts(wave_sz) {
+        }
+    };
+
+    // run by the task that inverted chunk b of a wave, while the other chunks are being
+    // inverted and claimed: looks the chunk's images up in the store, which nothing writes
+    // to meanwhile, and inserts the ones it lacks into the set of the wave's new circles.
+    void claim_images(const generation_context& ctxt, wave_merge& wm, size_t b,
+            const inversion_batch& batch) {
+        ctxt.store.find_batch(batch.circles, wm.stored[b]);
+        for (size_t i = 0; i < batch.circles.size(); ++i) {
+            if (!wm.stored[b][i]) {
+                wm.fresh.insert(batch.circles[i], image_id(b, i));
+            }
+        }
+    }
+
+    // moves the images of a wave of chunks, claimed as they were inverted, into the store
+    // exactly as merging the chunks one at a time in order would. The set of new circles
+    // keeps the image with the smallest id of each circle however the claims interleaved,
+    // so once every chunk has looked up the first image of each of its new circles, only
+    // the store itself is written on the calling thread, chunk by chunk: first images are
+    // inserted, and every other image reproduces the circle it duplicates.
+    void merge_wave(generation_context& ctxt, wave_merge& wm,
+            std::span<const inversion_batch> batches, generation_counts& counts) {
+        ctxt.pool.parallel_for(batches.size(), [&](size_t b) {
+            const auto& circles = batches[b].circles;
+            wm.firsts[b].resize(circles.size());
+            for (size_t i = 0; i < circles.size(); ++i) {
+                if (!wm.stored[b][i]) {
+                    wm.firsts[b][i] = *wm.fresh.find(circles[i]);
+                }
+            }
+        });
+
+        for (size_t b = 0; b < batches.size(); ++b) {
+            const auto& batch = batches[b];
+            auto& stored = wm.stored[b];
+            for (size_t i = 0; i < batch.circles.size(); ++i) {
+                if (stored[i]) {
+                    ctxt.store.reproduce(*stored[i]);
+                    continue;
+                }
+                auto first = wm.firsts[b][i];
+                if (first != image_id(b, i)) {
+                    ctxt.store.reproduce(*wm.stored[first >> 32][first & 0xFFFFFFFF]);
+                    continue;
+                }
+                auto [index, inserted] = ctxt.store.insert(batch.circles[i], batch.lineages[i]);
+                stored[i] = index;
+                if (inserted && ctxt.words) {
+                    ctxt.words->push_back(batch.words[i], ctxt.seeds);
+                }
+            }
+            for (auto known : batch.known) {
+                ctxt.store.reproduce(known);
+            }
+            counts.pairs += batch.pairs;
+            counts.known += batch.known.size();
+            counts.culled += batch.culled;
+            counts.lines += batch.lines;
+        }
+    }
+
+    // whether waves are merged through shards: only when the pool has more than one thread,
+    // since with one the claims would only add lookups to what merging the chunks one at a
+    // time does, and only into a store that does not merge near duplicates, where which
+    // circle an image lands on depends on the circles inserted before it. Either way the
+    // store ends up the same.
+    bool merges_in_shards(const generation_context& ctxt) {
+        return !ctxt.candidates && !ctxt.merge_near && ctxt.pool.size() > 1;
+    }
+
+    // moves the images of a wave of chunks into the store, or into the candidate queue,
+    // in chunk order, through shards if given a wave_merge to do it in.
+    void merge_chunks(generation_context& ctxt, wave_merge* wm,
+            std::span<const inversion_batch> batches, generation_counts& counts) {
+        if (!wm) {
+            for (const auto& batch : batches) {
+                merge_batch(ctxt, batch, counts);
+            }
+            return;
+        }
+        merge_wave(ctxt, *wm, batches, counts);
+    }
+
+    // the images of every batch of a generation, in batch order, gathered to be deduplicated
+    // together, with where each batch's images end and the circles it knew from lineage.
+    struct generation_images {
+        ici::circle_buffer circles;
+        std::vector<ici::lineage> lineages;
+        std::vector<ici::circle_word> words;
+        std::vector<size_t> batch_ends;
+        std::vector<uint32_t> known;
+        std::vector<size_t> known_ends;
+
+        void append(const inversion_batch& batch, bool with_words, generation_counts& counts) {
+            for (size_t i = 0; i < batch.circles.size(); ++i) {
+                circles.push_back(batch.circles[i]);
+            }
+            lineages.insert(lineages.end(), batch.lineages.begin(), batch.lineages.end());
+            if (with_words) {
+                words.insert(words.end(), batch.words.begin(), batch.words.end());
+            }
+            batch_ends.push_back(circles.size());
+            known.insert(known.end(), batch.known.begin(), batch.known.end());
+            known_ends.push_back(known.size());
+            counts.pairs += batch.pairs;
+            counts.known += batch.known.size();
+            counts.culled += batch.culled;
+            counts.lines += batch.lines;
+        }
+    };
+
+    // moves a generation's images into the store as merging its batches one at a time in
+    // order would, visiting only the first occurrence of each circle: later occurrences of a
+    // circle, like the circles known from lineage, only reproduce it, which does nothing once
+    // it has been reproduced or inserted in the same generation.
+    void merge_sorted(generation_context& ctxt, const generation_images& images) {
+        auto firsts = ici::first_occurrences(ctxt.pool, ctxt.store, images.circles);
+        size_t f = 0;
+        size_t k = 0;
+        for (size_t b = 0; b < images.batch_ends.size(); ++b) {
+            for (; f < firsts.size() && firsts[f].index < images.batch_ends[b]; ++f) {
+                auto [i, existing] = firsts[f];
+                if (existing != ici::first_occurrence::none) {
+                    ctxt.store.reproduce(existing);
+                    continue;
+                }
+                ctxt.store.insert(images.circles[i], images.lineages[i]);
+                if (ctxt.words) {
+                    ctxt.words->push_back(images.words[i], ctxt.seeds);
+                }
+            }
+            for (; k < images.known_ends[b]; ++k) {
+                ctxt.store.reproduce(images.known[k]);
+            }
+        }
+    }
+
+    using chunk_fn = std::function<void(size_t, inversion_batch&)>;
+
+    // inverts chunks [0, num_chunks) on the thread pool. Every chunk writes to its own
+    // buffer and the buffers are merged into the store in chunk order, one wave of chunks
+    // at a time, so the result does not depend on the number of threads. When sorting, the
+    // buffers are instead gathered and merged once every chunk is done, with the same result,
+    // since chunks only invert circles of earlier generations.
+    generation_counts generate_chunks(generation_context& ctxt, size_t num_chunks,
+            const chunk_fn& invert_chunk) {
+
+        auto wave_sz = static_cast<size_t>(ctxt.pool.size()) * k_chunks_per_thread;
+        std::vector<inversion_batch> batches(wave_sz);
+        generation_counts counts;
+        std::optional<generation_images> images;
+        std::optional<wave_merge> wm;
+        if (ctxt.sort_images && !ctxt.candidates) {
+            images.emplace();
+        } else if (merges_in_shards(ctxt)) {
+            wm.emplace(ctxt, wave_sz);
+        }
+
+        for (size_t wave = 0; wave < num_chunks; wave += wave_sz) {
+            auto n = std::min(wave_sz, num_chunks - wave);
+            if (wm) {
+                wm->fresh.clear();
+            }
+            ctxt.pool.parallel_for(n,
+                [&](size_t i) {
+                    batches[i].clear();
+                    invert_chunk(wave + i, batches[i]);
+                    if (wm) {
+                        claim_images(ctxt, *wm, i, batches[i]);
+                    }
+                }
+            );
+            if (images) {
+                for (const auto& batch : batches | rv::take(n)) {
+                    images->append(batch, ctxt.words != nullptr, counts);
+                }
+            } else {
+                merge_chunks(ctxt, wm ? &*wm : nullptr, std::span(batches).first(n), counts);
+            }
+        }
+        if (images) {
+            merge_sorted(ctxt, *images);
+        }
+
+        return counts;
+    }
+
+    // inverts the pairs [0, num_pairs) in fixed size chunks on the thread pool.
+    generation_counts generate_in_parallel(generation_context& ctxt, size_t num_pairs,
+            const pair_range_fn& invert_pairs) {
+        auto num_chunks = (num_pairs + k_pairs_per_chunk - 1) / k_pairs_per_chunk;
+        auto counts = generate_chunks(ctxt, num_chunks,
+            [&](size_t chunk, inversion_batch& out) {
+                invert_pairs(
+                    chunk * k_pairs_per_chunk,
+                    std::min(num_pairs, (chunk + 1) * k_pairs_per_chunk),
+                    out
+                );
+            }
+        );
+        counts.pairs = num_pairs;
+        return counts;
+    }
+
+    constexpr size_t k_circles_per_query_chunk = 1024;
+
+    // for each circle of lhs, the sorted positions in rhs of the circles near it, stored
+    // as one array with the offset of each circle's neighbors.
+    struct neighbor_lists {
+        std::vector<size_t> offsets;
+        std::vector<uint32_t> neighbors;
+    };
+
+    // two circles are near each other if their centers are within pair_radius_multiple
+    // times the larger of their radii. Each circle is indexed by the bounds of its reach,
+    // the circle scaled by that multiple about its center, so near circles are among those
+    // whose reaches intersect. If within, lhs and rhs are the same range and each pair is
+    // only listed under its lower position.
+    neighbor_lists find_neighbors(const generation_context& ctxt, const circle_range& lhs,
+            const circle_range& rhs, bool within) {
+        auto reach = [k = ctxt.pair_radius_multiple](const circle_range& rng, size_t i) {
+            auto c = rng.circles[rng.begin + i];
+            return ici::circle{ c.loc, k * c.radius };
+        };
+        ici::circle_tree tree(
+            rv::iota(size_t{ 0 }, rhs.size()) | rv::transform(
+                [&](size_t j) { return reach(rhs, j); }
+            )
+        );
+
+        std::vector<std::vector<uint32_t>> rows(lhs.size());
+        auto num_chunks =
+            (lhs.size() + k_circles_per_query_chunk - 1) / k_circles_per_query_chunk;
+        ctxt.pool.parallel_for(num_chunks,
+            [&](size_t chunk) {
+                auto end = std::min(lhs.size(), (chunk + 1) * k_circles_per_query_chunk);
+                for (auto i = chunk * k_circles_per_query_chunk; i < end; ++i) {
+                    auto x = reach(lhs, i);
+                    for (auto j : tree.intersecting_bounds(ici::bounds(x))) {
+                        auto y = reach(rhs, j);
+                        if ((!within || j > i) &&
+                                ici::distance(x.loc, y.loc) <= std::max(x.radius, y.radius)) {
+                            rows[i].push_back(j);
+                        }
+                    }
+                    r::sort(rows[i]);
+                }
+            }
+        );
+
+        neighbor_lists lists{ {0}, {} };
+        for (const auto& row : rows) {
+            lists.neighbors.insert(lists.neighbors.end(), row.begin(), row.end());
+            lists.offsets.push_back(lists.neighbors.size());
+        }
+        return lists;
+    }
+
+    double max_radius(const circle_range& rng) {
+        auto radii = std::span(rng.circles.r() + rng.begin, rng.size());
+        return radii.empty() ? 0.0 : r::max(radii);
+    }
+
+    // inverts only the pairs of near circles in lhs x rhs, or within lhs if within is set.
+    // For a pair that is skipped the centers are more than k times the larger radius M
+    // apart, so an image's radius R^2*r/(d^2 - r^2) is less than r/(k^2 - 1) where r is the
+    // smaller radius; the largest radius in the ranges divided by k^2 - 1 therefore bounds
+    // what was not generated.
+    generation_counts invert_neighbors(generation_context& ctxt, const circle_range& lhs,
+            const circle_range& rhs, bool within) {
+        auto lists = find_neighbors(ctxt, lhs, rhs, within);
+        auto counts = generate_in_parallel(ctxt, lists.neighbors.size(),
+            [&](size_t begin, size_t end, inversion_batch& out) {
+                // walk the chunk as runs of pairs that share their lhs circle, gathering
+                // each run's rhs circles so they can be inverted as a batch.
+                auto lineages = ctxt.store.lineages();
+                auto i = static_cast<size_t>(r::upper_bound(lists.offsets, begin) - 
+                    lists.offsets.begin()) - 1;
+                for (auto k = begin; k < end; ++i) {
+                    out.neighbors.clear();
+                    out.neighbor_ids.clear();
+                    for (auto row_end = std::min(lists.offsets[i + 1], end); k < row_end; ++k) {
+                        auto j = rhs.begin + lists.neighbors[k];
+                        out.neighbors.push_back(rhs.circles[j]);
+                        out.neighbor_ids.push_back(rhs.id(j));
+                    }
+                    auto near = whole(out.neighbors, out.neighbor_ids);
+                    invert_both_ways(
+                        out, ctxt, lineages, lhs, lhs.begin + i, near, 0, near.size()
+                    );
+                }
+            }
+        );
+        auto k = ctxt.pair_radius_multiple;
+        counts.skipped_radius = std::max(max_radius(lhs), max_radius(rhs)) / (k * k - 1.0);
+        return counts;
+    }
+
+    // inverts every pair of distinct circles in the range, both ways. Under a symmetry this
+    // also includes the pairs of each circle with the other circles of its own orbit.
+    generation_counts all_inversions(generation_context& ctxt, const circle_range& rng) {
+        if (ctxt.pair_radius_multiple > 0.0) {
+            return invert_neighbors(ctxt, rng, rng, true);
+        }
+        auto n = rng.size();
+        auto counts = generate_in_parallel(ctxt, ici::two_combinations_count(n),
+            [&](size_t begin, size_t end, inversion_batch& out) {
+                // walk the chunk as runs of pairs that share their first circle.
+                auto lineages = ctxt.store.lineages();
+                auto [i, j] = ici::nth_two_combination(n, begin);
+                for (auto k = begin; k < end; ++i, j = i + 1) {
+                    auto run = std::min(n - j, end - k);
+                    invert_both_ways(out, ctxt, lineages, rng, rng.begin + i, 
+                        rng, rng.begin + j, rng.begin + j + run);
+                    k += run;
+                }
+            }
+        );
+        if (ctxt.symmetry.trivial()) {
+            return counts;
+        }
+
+        counts.pairs *= ctxt.symmetry.size();
+        auto orbit_counts = generate_in_parallel(ctxt, n,
+            [&](size_t begin, size_t end, inversion_batch& out) {
+                for (auto i = rng.begin + begin; i < rng.begin + end; ++i) {
+                    invert_under_symmetry(out, ctxt, rng.circles[i], rng.id(i), rng, i, i + 1, 1);
+                }
+            }
+        );
+        orbit_counts.pairs *= ctxt.symmetry.size() - 1;
+        counts += orbit_counts;
+        return counts;
+    }
+
+    // inverts every pair in lhs x rhs, both ways.
+    generation_counts inverse_of_cartesian_product(generation_context& ctxt, 
+            const circle_range& lhs, const circle_range& rhs) {
+        if (ctxt.pair_radius_multiple > 0.0) {
+            return invert_neighbors(ctxt, lhs, rhs, false);
+        }
+        auto m = rhs.size();
+        auto counts = generate_in_parallel(ctxt, lhs.size() * m,
+            [&](size_t begin, size_t end, inversion_batch& out) {
+                auto lineages = ctxt.store.lineages();
+                for (auto k = begin; k < end; ) {
+                    auto j = k % m;
+                    auto run = std::min(m - j, end - k);
+                    invert_both_ways(out, ctxt, lineages, lhs, lhs.begin + k / m, 
+                        rhs, rhs.begin + j, rhs.begin + j + run);
+                    k += run;
+                }
+            }
+        );
+        counts.pairs *= ctxt.symmetry.size();
+        return counts;
+    }
+
+    // in closure mode row i of the pairs is circle i paired with every circle before it
+    // and, under a symmetry, with the rest of its own orbit. Each circle's row can be
+    // inverted as soon as the circle is in the store.
+    size_t row_length(const generation_context& ctxt, size_t i) {
+        return ctxt.symmetry.trivial() ? i : i + 1;
+    }
+
+    // inverts the pairs of row i in columns [from, to).
+    void invert_row(inversion_batch& out, const generation_context& ctxt,
+            std::span<const ici::lineage> lineages, const circle_range& all, size_t i,
+            size_t from, size_t to) {
+        auto n = ctxt.symmetry.size();
+        auto earlier_end = std::min(to, i);
+        if (from < earlier_end) {
+            invert_both_ways(out, ctxt, lineages, all, i, all, from, earlier_end);
+            out.pairs += (earlier_end - from) * n;
+        }
+        if (to > i) {
+            invert_under_symmetry(out, ctxt, all.circles[i], all.id(i), all, i, i + 1, 1);
+            out.pairs += n - 1;
+        }
+    }
+
+    // either several consecutive whole rows, or columns [from, to) of a single row.
+    struct row_chunk {
+        size_t row;
+        size_t rows;
+        size_t from;
+        size_t to;
+        int generation;
+    };
+
+    void invert_row_chunk(inversion_batch& out, const generation_context& ctxt,
+            std::span<const ici::lineage> lineages, const circle_range& all,
+            const row_chunk& chunk) {
+        if (chunk.rows == 1) {
+            invert_row(out, ctxt, lineages, all, chunk.row, chunk.from, chunk.to);
+            return;
+        }
+        for (auto i = chunk.row; i < chunk.row + chunk.rows; ++i) {
+            invert_row(out, ctxt, lineages, all, i, 0, row_length(ctxt, i));
+        }
+    }
+
+    // cuts rows into chunks of at most k_pairs_per_chunk pairs, packing short rows of the
+    // same generation together and splitting long ones. Where the cuts fall depends only
+    // on the row lengths and on where each generation ends, so the round and dataflow
+    // schedulers cut, and therefore merge, exactly the same chunks.
+    class row_chunker {
+        const generation_context& ctxt_;
+        size_t row_;
+        size_t from_;
+
+    public:
+        row_chunker(const generation_context& ctxt, size_t first_row) :
+            ctxt_(ctxt), row_(first_row), from_(0) {
+        }
+
+        size_t row() const {
+            return row_;
+        }
+
+        // the next chunk of the rows of generation before end, unless the rows so far
+        // might still be packed with a row at end. If complete, the generation ends at end.
+        std::optional<row_chunk> next(size_t end, bool complete, int generation) {
+            if (row_ >= end) {
+                return {};
+            }
+            auto len = row_length(ctxt_, row_);
+            if (len > k_pairs_per_chunk) {
+                row_chunk chunk{
+                    row_, 1, from_, std::min(from_ + k_pairs_per_chunk, len), generation
+                };
+                from_ = chunk.to;
+                if (from_ == len) {
+                    ++row_;
+                    from_ = 0;
+                }
+                return chunk;
+            }
+
+            size_t pairs = 0;
+            auto i = row_;
+            for (; i < end && pairs + row_length(ctxt_, i) <= k_pairs_per_chunk; ++i) {
+                pairs += row_length(ctxt_, i);
+            }
+            if (i == end && !complete && pairs + row_length(ctxt_, end) <= k_pairs_per_chunk) {
+                return {};
+            }
+            row_chunk chunk{ row_, i - row_, 0, row_length(ctxt_, row_), generation };
+            row_ = i;
+            return chunk;
+        }
+    };
+
+    // inverts the rows of the closure generation gen, one wave of chunks at a time.
+    generation_counts invert_rows(generation_context& ctxt, int gen) {
+        const auto& store = ctxt.store;
+        std::vector<row_chunk> chunks;
+        row_chunker chunker(ctxt, store.begin(gen));
+        while (auto chunk = chunker.next(store.end(gen), true, gen)) {
+            chunks.push_back(*chunk);
+        }
+        circle_range all{ store.circles(), 0, store.size(), {} };
+        return generate_chunks(ctxt, chunks.size(),
+            [&](size_t i, inversion_batch& out) {
+                invert_row_chunk(out, ctxt, store.lineages(), all, chunks[i]);
+            }
+        );
+    }
+
+    constexpr size_t k_circles_per_replica_block = 4096;
+
+    // expands each representative into its orbit under the symmetry group. Circles on an
+    // axis of the group, or at its center, are their own images, so the orbits are merged
+    // through a concurrent set that blocks of representatives are expanded into in parallel.
+    // Each image's id is its position in the orbits one after another, so the snapshot is
+    // what expanding them one at a time into a circle set would give.
+    std::vector<ici::circle> replicate(ici::thread_pool& pool,
+            const ici::symmetry_group& symmetry, const std::vector<ici::circle>& circles,
+            double eps, ici::tolerance_scale scale) {
+        if (symmetry.trivial()) {
+            return circles;
+        }
+        ici::concurrent_circle_set set(eps, scale,
+            static_cast<size_t>(pool.size()) * k_merge_shards_per_thread
+        );
+        auto blocks = (circles.size() + k_circles_per_replica_block - 1) /
+            k_circles_per_replica_block;
+        pool.parallel_for(blocks, [&](size_t b) {
+            auto end = std::min(circles.size(), (b + 1) * k_circles_per_replica_block);
+            for (auto i = b * k_circles_per_replica_block; i < end; ++i) {
+                for (auto g : rv::iota(size_t{ 0 }, symmetry.size())) {
+                    set.insert(symmetry.apply(g, circles[i]), i * symmetry.size() + g);
+                }
+            }
+        });
+        return set.snapshot();
+    }
+
+    constexpr size_t k_circles_per_sink_batch = 4096;
+
+    // passes circles to a sink in batches, expanding representatives into their orbits
+    // under the symmetry group. Distinct representatives have disjoint orbits, so only the
+    // images within an orbit, which coincide for circles on an axis, need deduplicating.
+    void emit(const ici::circle_sink& sink, const ici::symmetry_group& symmetry,
+            std::span<const ici::circle> circles, double eps) {
+        std::vector<ici::circle> batch;
+        for (const auto& c : circles) {
+            if (symmetry.trivial()) {
+                batch.push_back(c);
+            } else {
+                auto first = batch.size();
+                for (const auto& image : symmetry.orbit(c)) {
+                    auto same = [&](const ici::circle& d) {
+                        return std::abs(image.loc.x - d.loc.x) < eps &&
+                            std::abs(image.loc.y - d.loc.y) < eps &&
+                            std::abs(image.radius - d.radius) < eps;
+                    };
+                    if (r::none_of(batch | rv::drop(first), same)) {
+                        batch.push_back(image);
+                    }
+                }
+            }
+            if (batch.size() >= k_circles_per_sink_batch) {
+                sink(batch);
+                batch.clear();
+            }
+        }
+        if (!batch.empty()) {
+            sink(batch);
+        }
+    }
+
+    // when streaming, passes the sink the circles first found in generation gen.
+    void emit_generation(const generation_context& ctxt, int gen) {
+        if (!ctxt.sink) {
+            return;
+        }
+        const auto& store = ctxt.store;
+        auto circles = rv::iota(store.begin(gen), store.end(gen)) | rv::transform(
+                [&](size_t i) { return store[i]; }
+            ) | r::to<std::vector>();
+        emit(*ctxt.sink, ctxt.symmetry, circles, store.eps());
+    }
+
+    void report_iteration(int i, const generation_counts& counts, size_t circles) {
+        std::println(
+            "  iteration {}: {} inversions, {} known from lineage, {} culled, {} lines, "
+            "adding {} circles...",
+            i + 1, 2 * counts.pairs - counts.known, counts.known, counts.culled, counts.lines,
+            circles
+        );
+        if (counts.skipped_radius > 0.0) {
+            std::println("    pairs that were not near skipped images of radius below {}",
+                counts.skipped_radius
+            );
+        }
+    }
+
+    // whether to stop after the iteration that first found the circles [begin, end) of the
+    // store, if iterations are adaptive: when it found none, or when the largest of them in
+    // the view would be too small to show.
+    bool should_stop(const generation_context& ctxt, size_t begin, size_t end) {
+        if (!ctxt.auto_stop) {
+            return false;
+        }
+        if (begin == end) {
+            std::println("  no new circles, stopping.");
+            return true;
+        }
+        const auto& [view, stop_radius] = *ctxt.auto_stop;
+        double largest = 0.0;
+        for (auto i = begin; i < end; ++i) {
+            auto c = ctxt.store[i];
+            if (c.radius > largest && any_in_orbit(ctxt, c,
+                    [&](const ici::circle& image) {
+                        return ici::circle_rectangle_intersection(image, view);
+                    })) {
+                largest = c.radius;
+            }
+        }
+        std::println("    largest new circle in view has radius {}", largest);
+        if (largest < stop_radius) {
+            std::println("  new circles are too small to show, stopping.");
+            return true;
+        }
+        return false;
+    }
+
+    void save_checkpoint(const generation_context& ctxt) {
+        if (ctxt.checkpoints) {
+            ctxt.checkpoints->write(ctxt.store.generation(), ctxt.store,
+                ctxt.words ? ctxt.words->words() : std::vector<ici::circle_word>{}
+            );
+        }
+    }
+
+    // whether a run resumed from a checkpoint had already ended there, because its last
+    // iteration found nothing new or found only circles too small to show.
+    bool ended_at_checkpoint(const generation_context& ctxt, bool closure) {
+        const auto& store = ctxt.store;
+        auto gen = store.generation();
+        if (gen == 0) {
+            return false;
+        }
+        if (closure && store.begin(gen) == store.end(gen)) {
+            std::println("  closed under inversion.");
+            return true;
+        }
+        return should_stop(ctxt, store.begin(gen), store.end(gen));
+    }
+
+    // each iteration inverts the pairs within the current frontier and the pairs between
+    // the previous and current frontiers, where a frontier is every circle the iteration
+    // produced, including circles that earlier iterations had already found.
+    std::vector<ici::circle> generate_frontier(generation_context& ctxt, int iterations) {
+        auto& store = ctxt.store;
+        if (ended_at_checkpoint(ctxt, false)) {
+            return store.generated_circles();
+        }
+
+        for (int i : rv::iota(store.generation(), iterations)) {
+            auto prev_ids = store.previous() | r::to<std::vector>();
+            auto prev = store.gather(prev_ids);
+            auto curr = store.gather(store.current());
+
+            store.start_generation();
+            auto counts = all_inversions(ctxt, whole(curr, store.previous()));
+            counts += inverse_of_cartesian_product(
+                ctxt, whole(prev, prev_ids), whole(curr, store.previous())
+            );
+
+            report_iteration(i, counts, store.current().size());
+            save_checkpoint(ctxt);
+            if (should_stop(ctxt, store.begin(i + 1), store.end(i + 1))) {
+                break;
+            }
+        }
+
+        return store.generated_circles();
     }
 
-    ici::circle_set circle_set_union(const ici::circle_set& lhs, const ici::circle_set& rhs) {
-        ici::circle_set output(lhs.eps(), lhs.to_vector());
-        auto rhs_circles = rhs.to_vector();
-        for (auto&& c : rhs_circles) {
-            output.insert(c);
+    // semi-naive evaluation of the closure of the seeds under inversion: each iteration only
+    // inverts pairs that include at least one circle first found by the iteration before it,
+    // pairing those new circles with each other and with all older circles, which are the
+    // rows of the new circles. Every pair of distinct circles is therefore inverted exactly
+    // once over the whole run.
+    std::vector<ici::circle> generate_closure(generation_context& ctxt, int iterations) {
+        auto& store = ctxt.store;
+        for (int gen : rv::iota(0, store.generation() + 1)) {
+            emit_generation(ctxt, gen);
+        }
+        if (ended_at_checkpoint(ctxt, true)) {
+            return ctxt.sink ? std::vector<ici::circle>{} : store.all_circles();
+        }
+
+        for (int i : rv::iota(store.generation(), iterations)) {
+            auto gen = store.generation();
+            circle_range old_circles{ store.circles(), 0, store.begin(gen), {} };
+            circle_range new_circles{ store.circles(), store.begin(gen), store.end(gen), {} };
+
+            store.start_generation();
+            generation_counts counts;
+            if (ctxt.pair_radius_multiple > 0.0) {
+                counts = all_inversions(ctxt, new_circles);
+                counts += inverse_of_cartesian_product(ctxt, new_circles, old_circles);
+            } else {
+                counts = invert_rows(ctxt, gen);
+            }
+
+            auto added = store.end(gen + 1) - store.begin(gen + 1);
+            report_iteration(i, counts, added);
+            emit_generation(ctxt, gen + 1);
+            save_checkpoint(ctxt);
+            if (added == 0) {
+                std::println("  closed under inversion.");
+                break;
+            }
+            if (should_stop(ctxt, store.begin(gen + 1), store.end(gen + 1))) {
+                break;
+            }
         }
+
+        return ctxt.sink ? std::vector<ici::circle>{} : store.all_circles();
+    }
+
+    // the store as it was at some point, for inverting rows on the thread pool while the
+    // store itself grows.
+    struct store_snapshot {
+        ici::circle_buffer circles;
+        std::vector<ici::lineage> lineages;
+        ici::word_buffer words;
+    };
+
+    std::shared_ptr<store_snapshot> take_snapshot(const generation_context& ctxt) {
+        return std::make_shared<store_snapshot>(store_snapshot{
+            ctxt.store.circles(),
+            ctxt.store.lineages() | r::to<std::vector>(),
+            ctxt.words ? *ctxt.words : ici::word_buffer{}
+        });
+    }
+
+    // a new snapshot is taken when the pool would otherwise run dry, or once the store has
+    // grown by this fraction of the last one, so copying stays linear in the output.
+    constexpr size_t k_snapshot_growth_divisor = 8;
+
+    // closure generation without rounds: a circle's row is posted to the pool as soon as
+    // the circle is in the store, against a snapshot that includes it, while the main
+    // thread merges finished chunks. Chunks are cut as in generate_closure and merged in
+    // row order, which is the order it merges them in, so the store ends up the same; only
+    // the barrier at the end of each generation is gone. A generation is reported, and
+    // adaptive stopping checked, when the first of its rows is merged, by which time every
+    // row that could add to it has been.
+    std::vector<ici::circle> generate_closure_dataflow(generation_context& ctxt, int iterations) {
+        struct posted_chunk {
+            int generation;
+            std::shared_ptr<inversion_batch> batch;
+            std::future<void> done;
+        };
+
+        auto& store = ctxt.store;
+        auto max_in_flight = static_cast<size_t>(ctxt.pool.size()) * k_chunks_per_thread;
+        std::deque<posted_chunk> in_flight;
+        std::vector<std::shared_ptr<inversion_batch>> spare;
+        auto snapshot = take_snapshot(ctxt);
+        row_chunker chunker(ctxt, 0);
+        auto depth = iterations;
+        generation_counts counts;
+
+        auto post_next = [&]() {
+            auto row = chunker.row();
+            if (row >= store.size() || store.first_generation(row) >= depth) {
+                return false;
+            }
+            auto gen = store.first_generation(row);
+            auto complete = store.generation() > gen || in_flight.empty() ||
+                in_flight.front().generation >= gen;
+            auto end = std::min(store.end(gen), snapshot->circles.size());
+            auto chunk = chunker.next(end, complete && end == store.end(gen), gen);
+            if (!chunk) {
+                return false;
+            }
+
+            std::shared_ptr<inversion_batch> batch;
+            if (spare.empty()) {
+                batch = std::make_shared<inversion_batch>();
+            } else {
+                batch = spare.back();
+                spare.pop_back();
+                batch->clear();
+            }
+            auto task = std::make_shared<std::packaged_task<void()>>(
+                [&ctxt, snapshot, batch, chunk = *chunk]() {
+                    auto task_ctxt = ctxt;
+                    if (task_ctxt.words) {
+                        task_ctxt.words = &snapshot->words;
+                    }
+                    circle_range all{ snapshot->circles, 0, snapshot->circles.size(), {} };
+                    invert_row_chunk(*batch, task_ctxt, snapshot->lineages, all, chunk);
+                }
+            );
+            in_flight.push_back({ gen, batch, task->get_future() });
+            ctxt.pool.post([task]() { (*task)(); });
+            return true;
+        };
+
+        // reports generation gen, now complete, and returns whether to stop before it.
+        auto finish_generation = [&](int gen) {
+            emit_generation(ctxt, gen);
+            if (gen == 0) {
+                return false;
+            }
+            report_iteration(gen - 1, counts, store.end(gen) - store.begin(gen));
+            counts = {};
+            return should_stop(ctxt, store.begin(gen), store.end(gen));
+        };
+
+        bool stopped = false;
+        while (true) {
+            while (in_flight.size() < max_in_flight && post_next()) {
+            }
+            auto snapshot_sz = snapshot->circles.size();
+            if (in_flight.size() < max_in_flight && store.size() > snapshot_sz &&
+                    (in_flight.empty() ||
+                        store.size() - snapshot_sz >= snapshot_sz / k_snapshot_growth_divisor)) {
+                snapshot = take_snapshot(ctxt);
+                continue;
+            }
+            if (in_flight.empty()) {
+                break;
+            }
+
+            auto chunk = std::move(in_flight.front());
+            in_flight.pop_front();
+            try {
+                chunk.done.get();
+            } catch (...) {
+                for (auto& pending : in_flight) {
+                    pending.done.wait();
+                }
+                throw;
+            }
+            spare.push_back(chunk.batch);
+            if (chunk.generation >= depth) {
+                continue;
+            }
+            if (chunk.generation == store.generation()) {
+                if (finish_generation(chunk.generation)) {
+                    depth = chunk.generation;
+                    stopped = true;
+                    continue;
+                }
+                store.start_generation();
+            }
+            // the pool is busy inverting the chunks in flight, so the chunk is merged on
+            // this thread rather than through shards the pool would only get to later.
+            merge_chunks(ctxt, nullptr, std::span(chunk.batch.get(), 1), counts);
+        }
+
+        auto gen = store.generation();
+        if (gen == 0) {
+            emit_generation(ctxt, 0);
+        } else if (!stopped) {
+            auto added = store.end(gen) - store.begin(gen);
+            report_iteration(gen - 1, counts, added);
+            emit_generation(ctxt, gen);
+            if (added == 0) {
+                std::println("  closed under inversion.");
+            } else {
+                should_stop(ctxt, store.begin(gen), store.end(gen));
+            }
+        }
+
+        return ctxt.sink ? std::vector<ici::circle>{} : store.all_circles();
+    }
+
+    constexpr size_t k_circles_per_budget_generation = 1024;
+
+    // best-first generation within a budget of max_circles. As in closure mode, every pair
+    // of accepted circles is inverted exactly once, but images go to the candidate queue
+    // rather than the store, and each generation accepts the best candidates, up to a
+    // fixed number at a time, until the budget is spent or there are none left.
+    std::vector<ici::circle> generate_within_budget(generation_context& ctxt, 
+            size_t max_circles) {
+        auto& store = ctxt.store;
+        auto& candidates = *ctxt.candidates;
+
+        for (int i = 0; store.size() < max_circles; ++i) {
+            auto gen = store.generation();
+            circle_range old_circles{ store.circles(), 0, store.begin(gen), {} };
+            circle_range new_circles{ store.circles(), store.begin(gen), store.end(gen), {} };
+
+            candidates.set_capacity(max_circles - store.size());
+            auto counts = all_inversions(ctxt, new_circles);
+            counts += inverse_of_cartesian_product(ctxt, new_circles, old_circles);
+            if (candidates.empty()) {
+                std::println("  closed under inversion.");
+                break;
+            }
+
+            store.start_generation();
+            auto n = std::min(k_circles_per_budget_generation, max_circles - store.size());
+            for (size_t k = 0; k < n && !candidates.empty(); ++k) {
+                accept(ctxt, candidates.pop());
+            }
+            report_iteration(i, counts, store.end(gen + 1) - store.begin(gen + 1));
+        }
+
+        return store.all_circles();
+    }
+
+    // how far a circle is from reaching the view, 0 if it intersects it.
+    double distance_to_view(const ici::rectangle& view, const ici::circle& c) {
+        auto dx = std::max({ view.min.x - c.loc.x, 0.0, c.loc.x - view.max.x });
+        auto dy = std::max({ view.min.y - c.loc.y, 0.0, c.loc.y - view.max.y });
+        return std::max(std::hypot(dx, dy) - c.radius, 0.0);
+    }
+
+    ici::candidate_queue::priority_fn budget_priority_fn(const ici::input& inp) {
+        if (inp.priority == ici::budget_priority::closest_to_view) {
+            auto view = *std::get<ici::raster_settings>(inp.output_settings).view;
+            return [view](const ici::circle& c) { return -distance_to_view(view, c); };
+        }
+        return [](const ici::circle& c) { return c.radius; };
+    }
+
+    // a circle on the depth-first path, the seed it was last inverted in, and the next seed
+    // to try inverting it in.
+    struct word_step {
+        ici::circle circle;
+        size_t last;
+        size_t next;
+    };
+
+    // appends to output the images of start under every reduced word of inversions in the
+    // seeds that does not begin with the inversion last, walking the words depth first with
+    // one step per letter on the stack. A branch ends at max_depth letters or at an image
+    // that is a line, smaller than the minimum radius, or outside the region of interest.
+    // With a sink, output is passed to it and cleared whenever it fills a batch.
+    void enumerate_words(const ici::input& inp, const ici::circle& start, size_t last,
+            int max_depth, const ici::circle_sink* sink, std::vector<ici::circle>& output) {
+        const auto& seeds = inp.circles;
+        std::vector<word_step> stack{ { start, last, 0 } };
+        output.push_back(start);
+
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            if (static_cast<int>(stack.size()) >= max_depth || top.next == seeds.size()) {
+                stack.pop_back();
+                continue;
+            }
+            auto i = top.next++;
+            if (i == top.last) {
+                continue;
+            }
+            auto image = ici::invert(seeds[i], top.circle);
+            if (!image || image->radius < inp.min_radius || 
+                    (inp.roi && !ici::in_region(*inp.roi, seeds[i], top.circle, *image))) {
+                continue;
+            }
+            output.push_back(*image);
+            stack.push_back({ *image, i, 0 });
+            if (sink && output.size() >= k_circles_per_sink_batch) {
+                (*sink)(output);
+                output.clear();
+            }
+        }
+    }
+
+    // the images of the seeds under all reduced words of inversions in the seeds of up to
+    // max_depth letters. Inverting in a seed twice in a row is the identity, so reduced
+    // words never do; that is the only duplicate elimination, and there is no circle set,
+    // so memory is the output plus one stack per thread. The words are split by their first
+    // letter and seed into tasks whose outputs are concatenated in order, or, with a sink,
+    // passed to it a batch at a time, in which case nothing is kept.
+    std::vector<ici::circle> generate_depth_first(ici::thread_pool& pool, 
+            const ici::input& inp, int max_depth, const ici::circle_sink* sink) {
+        const auto& seeds = inp.circles;
+        auto n = seeds.size();
+        std::vector<std::vector<ici::circle>> outputs(n * n);
+        std::atomic<size_t> streamed{ 0 };
+        ici::circle_sink counted = [&streamed, sink](std::span<const ici::circle> circles) {
+            streamed += circles.size();
+            (*sink)(circles);
+        };
+        if (sink) {
+            sink = &counted;
+            (*sink)(seeds);
+        }
+        // each task starts from a word of one letter, so with no letters there is nothing
+        // to enumerate past the seeds.
+        if (max_depth < 1) {
+            std::println("  enumerated {} circles to depth {}", seeds.size(), max_depth);
+            return sink ? std::vector<ici::circle>{} : seeds;
+        }
+
+        pool.parallel_for(n * n,
+            [&](size_t k) {
+                auto [seed, letter] = std::tuple{ k / n, k % n };
+                if (seed == letter) {
+                    return;
+                }
+                auto image = ici::invert(seeds[letter], seeds[seed]);
+                if (image && image->radius >= inp.min_radius && 
+                        (!inp.roi || ici::in_region(*inp.roi, seeds[letter], seeds[seed], *image))) {
+                    enumerate_words(inp, *image, letter, max_depth, sink, outputs[k]);
+                }
+                if (sink) {
+                    (*sink)(outputs[k]);
+                    outputs[k] = {};
+                }
+            }
+        );
+
+        auto output = sink ? std::vector<ici::circle>{} : seeds;
+        for (const auto& circles : outputs) {
+            output.insert(output.end(), circles.begin(), circles.end());
+        }
+        std::println("  enumerated {} circles to depth {}",
+            sink ? streamed.load() : output.size(), max_depth
+        );
         return output;
     }
 }
 
-std::vector<ici::circle> ici::invert_circles(const ici::input& inp)
+bool ici::in_region(const region_of_interest& roi, const circle& inverter,
+        const circle& invertee, const circle& image) {
+    return image_in_region(roi, inverter, invertee, image,
+        [](const circle& c, auto pred) { return pred(c); }
+    );
+}
+
+void ici::cull_to_region(const region_of_interest& roi, const circle& lhs, bool lhs_is_inverter,
+        const circle_buffer& rhs, circle_buffer& images, std::vector<uint32_t>& sources,
+        size_t first) {
+    auto kept = first;
+    for (auto i = first; i < images.size(); ++i) {
+        auto c = images[i];
+        auto other = rhs[sources[i]];
+        if (lhs_is_inverter ? in_region(roi, lhs, other, c) : in_region(roi, other, lhs, c)) {
+            images.set(kept, c);
+            sources[kept++] = sources[i];
+        }
+    }
+    images.resize(kept);
+    sources.resize(kept);
+}
+
+std::vector<ici::circle> ici::invert_circles(const ici::input& inp, const circle_sink& sink)
 {
-    std::println("inverting {}...", inp.fname);
+    std::println("inverting {} on {} thread(s) ({})...", 
+        inp.fname, inp.threads, to_string(detect_simd_level())
+    );
 
-    circle_set output(inp.eps);
-    circle_set prev(inp.eps);
-    circle_set curr(inp.eps, inp.circles);
+    if (inp.min_radius > 0.0) {
+        std::println("  culling circles with radius below {}", inp.min_radius);
+    }
+    if (inp.pair_radius_multiple > 0.0) {
+        std::println("  only pairing circles within {} times the larger radius",
+            inp.pair_radius_multiple
+        );
+    }
+    if (inp.auto_stop) {
+        std::println("  iterating until new circles in view are smaller than {}",
+            inp.auto_stop->radius
+        );
+    }
+    if (inp.scheduler == generation_scheduler::dataflow) {
+        std::println("  scheduling rows as soon as their circles are found");
+    }
+    if (inp.max_circles > 0) {
+        std::println("  generating up to {} circles, {} first", inp.max_circles,
+            (inp.priority == budget_priority::largest) ? "largest" : "closest to the view"
+        );
+    }
+    if (inp.roi) {
+        std::println("  generating for view [ {}, {}, {}, {} ] to within {}",
+            inp.roi->view.min.x, inp.roi->view.min.y, inp.roi->view.max.x, inp.roi->view.max.y,
+            inp.roi->error
+        );
+    }
 
-    for (int i : rv::iota(0, inp.iterations)) {
-        auto new_inversions = circle_set_union(
-            all_inversions(curr), inverse_of_cartesian_product(prev, curr)
+    if (inp.mode == generation_mode::depth_first) {
+        thread_pool pool(inp.threads);
+        auto output = generate_depth_first(pool, inp, inp.iterations, sink ? &sink : nullptr);
+        std::println("complete.");
+        return output;
+    }
+    if (inp.mode == generation_mode::out_of_core) {
+        thread_pool pool(inp.threads);
+        generate_out_of_core(pool, inp, sink);
+        std::println("complete.");
+        return {};
+    }
+    if (inp.worker_processes > 0) {
+        auto output = generate_sharded(inp, sink ? &sink : nullptr);
+        std::println("complete.");
+        return output;
+    }
+
+    // the Möbius engine keeps each circle's word over the seeds, which canonicalizing images
+    // under a symmetry would invalidate, local pairing finds the neighbors of the
+    // representatives rather than of their images, and a budget is meant to bound the
+    // output, which replication multiplies, so none of these is combined with symmetry.
+    auto use_words = inp.engine == inversion_engine::mobius;
+    auto symmetry = (inp.symmetry && !use_words && inp.pair_radius_multiple == 0.0 &&
+            inp.max_circles == 0) ?
+        detect_symmetry(inp.circles, inp.eps) : symmetry_group{};
+    if (use_words) {
+        std::println("  composing inversions as Möbius transformations");
+    }
+    if (!symmetry.trivial()) {
+        std::println("  generating a fundamental domain of {}{}-fold symmetry",
+            symmetry.dihedral() ? "dihedral " : "", symmetry.order()
         );
+    }
 
-        std::println("  iteration {}: adding {} circles...", i + 1, new_inversions.size());
+    thread_pool pool(inp.threads);
+    circle_store store(inp.eps, inp.circles | rv::transform(
+            [&](auto&& c) { return symmetry.canonical(c, inp.eps); }
+        ) | r::to<std::vector>(), inp.tolerance, inp.merge_near_duplicates
+    );
+    auto seeds = store.all_circles();
+    word_buffer words(rv::iota(uint32_t{ 0 }, static_cast<uint32_t>(seeds.size())) | rv::transform(
+            [](uint32_t i) { return circle_word{ identity_transform(), i }; }
+        ) | r::to<std::vector>(), seeds);
+    std::optional<checkpointer> checkpoints;
+    if (!inp.checkpoint_dir.empty()) {
+        checkpoints.emplace(inp.checkpoint_dir, inp);
+        if (auto resumed = checkpoints->read_latest(inp.iterations)) {
+            std::println("  resuming from the checkpoint after iteration {}", resumed->iteration);
+            store = std::move(resumed->store);
+            words = word_buffer(resumed->words, seeds);
+        }
+    }
+    generation_context ctxt{ 
+        pool, store, inp.min_radius, inp.roi, inp.auto_stop, symmetry, 
+        inp.pair_radius_multiple, seeds, use_words ? &words : nullptr, nullptr,
+        sink ? &sink : nullptr, checkpoints ? &*checkpoints : nullptr,
+        inp.deduplication == deduplication_strategy::sort, inp.tolerance, inp.merge_near_duplicates
+    };
 
-        prev = curr;
-        curr = new_inversions;
-        output = circle_set_union(output, curr);
+    std::vector<circle> output;
+    if (inp.max_circles > 0) {
+        candidate_queue candidates(inp.eps, inp.tolerance, budget_priority_fn(inp));
+        ctxt.candidates = &candidates;
+        output = generate_within_budget(ctxt, inp.max_circles);
+    } else {
+        std::vector<circle> circles;
+        if (inp.mode == generation_mode::frontier) {
+            circles = generate_frontier(ctxt, inp.iterations);
+        } else if (inp.scheduler == generation_scheduler::dataflow) {
+            circles = generate_closure_dataflow(ctxt, inp.iterations);
+        } else {
+            circles = generate_closure(ctxt, inp.iterations);
+        }
+        output = replicate(pool, symmetry, circles, inp.eps, inp.tolerance);
+    }
+    if (inp.merge_near_duplicates) {
+        std::println("  merged {} near-duplicate circles", store.near_duplicates());
     }
 
     std::println("complete.");
 
-    return (!output.empty()) ? output.to_vector() : inp.circles;
+    // closure generation passes its circles to the sink as it goes; the other modes only
+    // know theirs at the end.
+    auto streamed = sink && inp.mode == generation_mode::closure && inp.max_circles == 0;
+    if (output.empty() && !streamed) {
+        output = inp.circles;
+    }
+    if (sink) {
+        emit(sink, symmetry_group{}, output, inp.eps);
+        return {};
+    }
+    return output;
 }
 
 void ici::to_svg(const std::string& fname, const std::vector<circle>& inp_circles,
@@ -372,3 +1927,41 @@ ici::image ici::to_raster( const std::string& outp, const rectangle& view_rect,
     
     return img;
 }
+
+ici::image ici::stream_to_raster(const ici::input& inp) {
+    // generation runs on this thread and the pool while a consumer stamps each batch of
+    // circles into the coverage counts; the queue bounds how far generation runs ahead.
+    constexpr size_t k_batches_in_queue = 16;
+
+    const auto& settings = std::get<raster_settings>(inp.output_settings);
+    coverage counts(*settings.view, settings);
+    circle_queue queue(k_batches_in_queue);
+    size_t stamped = 0;
+
+    std::jthread rasterizer(
+        [&]() {
+            while (auto batch = queue.pop()) {
+                for (const auto& c : *batch) {
+                    counts.add(c);
+                }
+                stamped += batch->size();
+            }
+        }
+    );
+    try {
+        invert_circles(inp,
+            [&](std::span<const circle> circles) {
+                queue.push({ circles.begin(), circles.end() });
+            }
+        );
+    } catch (...) {
+        queue.close();
+        throw;
+    }
+    queue.close();
+    rasterizer.join();
+
+    std::println("");
+    std::println("rasterized {} circles as they were generated", stamped);
+    return counts.to_image(settings.color_tbl);
+}
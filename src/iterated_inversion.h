@@ -3,6 +3,8 @@
 #include <vector>
 #include <optional>
 #include <string>
+#include <span>
+#include <functional>
 #include "image.h"
 #include "geometry.h"
 
@@ -14,12 +16,34 @@ namespace ici {
     struct circle;
     struct vector_settings;
     struct raster_settings;
+    struct region_of_interest;
+    class circle_buffer;
 
-    std::vector<circle> invert_circles(const ici::input& inp);
+    // receives generated circles in batches, possibly from several threads at once.
+    using circle_sink = std::function<void(std::span<const circle>)>;
+
+    // whether the image of invertee about inverter is worth expanding when generating for
+    // a region of interest.
+    bool in_region(const region_of_interest& roi, const circle& inverter,
+        const circle& invertee, const circle& image);
+
+    // removes the images from position first on that are not worth expanding, where each is
+    // the image of lhs about the circle of rhs its source indexes if lhs_is_inverter, and of
+    // that circle about lhs otherwise.
+    void cull_to_region(const region_of_interest& roi, const circle& lhs, bool lhs_is_inverter,
+        const circle_buffer& rhs, circle_buffer& images, std::vector<uint32_t>& sources,
+        size_t first);
+
+    // if sink is set, circles are passed to it as they become final, in no particular
+    // order, and the returned vector is empty.
+    std::vector<circle> invert_circles(const ici::input& inp, const circle_sink& sink = {});
 
     void to_svg(const std::string& fname, const std::vector<circle>& circles,
         const vector_settings& settings);
 
     ici::image to_raster(const std::string& outp, const rectangle& view_rect,
         const std::vector<circle>& inp, const raster_settings& settings);
+
+    // generates the circles and rasterizes them into the input's view at the same time.
+    ici::image stream_to_raster(const ici::input& inp);
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include "iterated_inversion.h"
 #include "input.h"
 #include "util.h"
+#include "circle_cache.h"
+#include "sharded_generation.h"
 #include <expected>
 #include <stdexcept>
 #include <chrono>
@@ -28,19 +30,52 @@ namespace {
         }
         return ici::parse_input(argv[1]);
     }
+
+    // the generated circles, from the cache if they were generated before with the same
+    // seeds and generation settings, whatever the output settings were.
+    std::vector<ici::circle> generate(const ici::input& inp) {
+        if (inp.cache_dir.empty()) {
+            return ici::invert_circles(inp);
+        }
+        ici::circle_cache cache(inp.cache_dir, inp.cache_size);
+        auto key = ici::generation_key(inp, true);
+        if (auto circles = cache.find(key)) {
+            std::println("found {} circles for {} in the cache.", circles->size(), inp.fname);
+            return *circles;
+        }
+        auto circles = ici::invert_circles(inp);
+        cache.insert(key, circles);
+        return circles;
+    }
 }
 
 int main(int argc, char* argv[]) {
 
+    // generation with worker processes runs copies of this executable as the workers.
+    if (argc == 2 && std::string(argv[1]) == "--worker") {
+        return ici::run_worker();
+    }
+
     try {
         auto input = parse_cmd_line(argc, argv);
         if (!input.has_value()) {
             throw input.error();
         }
 
-        auto circles = ici::invert_circles(*input);
-
         auto fname = fs::path(input->out_file).filename().string();
+        if (input->streaming) {
+            auto img = ici::stream_to_raster(*input);
+            std::println("serializing to {} format ({})...",
+                fs::path(fname).extension().string(),
+                fname
+            );
+            ici::write_to_file(input->out_file, img);
+            std::println("complete.");
+            return 0;
+        }
+
+        auto circles = generate(*input);
+
         std::println("");
         if (std::holds_alternative<ici::vector_settings>(input->output_settings)) {
             std::println("serializing circles to svg ({})...", fname);
@@ -0,0 +1,314 @@
+#include "mobius.h"
+#include <cmath>
+#include <limits>
+#include <array>
+#include <algorithm>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    using complex = std::complex<double>;
+
+    // a circle as the Hermitian form |z|^2 - conj(c)*z - c*conj(z) + |c|^2 - r^2, i.e. the
+    // matrix [[a, b], [conj(b), d]] with a and d real.
+    struct hermitian {
+        double a;
+        complex b;
+        double d;
+    };
+
+    ici::mobius normalize(complex a, complex b, complex c, complex d, bool conjugate) {
+        auto scale = 1.0 / std::sqrt(std::abs(a * d - b * c));
+        return { a * scale, b * scale, c * scale, d * scale, conjugate };
+    }
+
+    // N^* H N for H Hermitian, where N^* is the conjugate transpose of N.
+    hermitian congruence(const hermitian& h, complex n00, complex n01, complex n10, complex n11) {
+        // H * N
+        auto hn00 = h.a * n00 + h.b * n10;
+        auto hn01 = h.a * n01 + h.b * n11;
+        auto hn10 = std::conj(h.b) * n00 + h.d * n10;
+        auto hn11 = std::conj(h.b) * n01 + h.d * n11;
+        // N^* * (H * N)
+        return {
+            (std::conj(n00) * hn00 + std::conj(n10) * hn10).real(),
+            std::conj(n00) * hn01 + std::conj(n10) * hn11,
+            (std::conj(n01) * hn01 + std::conj(n11) * hn11).real()
+        };
+    }
+
+    // pairs are composed this many at a time before their images are computed.
+    constexpr size_t k_block_size = 64;
+
+    // the matrices of a block of pairs: consecutive matrices of a buffer, or, with a step of
+    // zero, the same matrix for every pair.
+    struct matrix_array {
+        const complex* a;
+        const complex* b;
+        const complex* c;
+        const complex* d;
+        size_t step;
+
+        matrix_array(const ici::matrix_buffer& m, size_t first) :
+            a(m.a.data() + first), b(m.b.data() + first), c(m.c.data() + first),
+            d(m.d.data() + first), step(1) {
+        }
+
+        matrix_array(const ici::mobius& m) : a(&m.a), b(&m.b), c(&m.c), d(&m.d), step(0) {
+        }
+    };
+
+    struct product_block {
+        std::array<complex, k_block_size> a;
+        std::array<complex, k_block_size> b;
+        std::array<complex, k_block_size> c;
+        std::array<complex, k_block_size> d;
+    };
+
+    // the products of n inversions lhs with the transforms rhs, computed as compose does;
+    // an inversion is anti-Möbius, so it conjugates the matrix it is composed with.
+    void compose_inversions(const matrix_array& lhs, const matrix_array& rhs, size_t n,
+            product_block& out) {
+        for (size_t i = 0; i < n; ++i) {
+            auto l = i * lhs.step;
+            auto r = i * rhs.step;
+            auto ra = std::conj(rhs.a[r]);
+            auto rb = std::conj(rhs.b[r]);
+            auto rc = std::conj(rhs.c[r]);
+            auto rd = std::conj(rhs.d[r]);
+            auto a = lhs.a[l] * ra + lhs.b[l] * rc;
+            auto b = lhs.a[l] * rb + lhs.b[l] * rd;
+            auto c = lhs.c[l] * ra + lhs.d[l] * rc;
+            auto d = lhs.c[l] * rb + lhs.d[l] * rd;
+            auto scale = 1.0 / std::sqrt(std::abs(a * d - b * c));
+            out.a[i] = a * scale;
+            out.b[i] = b * scale;
+            out.c[i] = c * scale;
+            out.d[i] = d * scale;
+        }
+    }
+
+    // returns whether the image was skipped as a line.
+    bool append_image(const ici::circle_word& image, const ici::circle& seed, double min_radius,
+            uint32_t source, std::vector<ici::circle_word>& words, ici::circle_buffer& output,
+            std::vector<uint32_t>& sources) {
+        auto c = ici::apply(image.transform, seed);
+        if (c && c->radius >= min_radius) {
+            words.push_back(image);
+            output.push_back(*c);
+            sources.push_back(source);
+        }
+        return !c;
+    }
+}
+
+ici::mobius ici::identity_transform() {
+    return { 1.0, 0.0, 0.0, 1.0, false };
+}
+
+ici::mobius ici::inversion_transform(const circle& c) {
+    // z -> c + R^2 / conj(z - c) = (c*conj(z) + R^2 - |c|^2) / (conj(z) - conj(c))
+    complex center{ c.loc.x, c.loc.y };
+    return normalize(
+        center, c.radius * c.radius - std::norm(center), 1.0, -std::conj(center), true
+    );
+}
+
+ici::mobius ici::compose(const mobius& lhs, const mobius& rhs) {
+    // lhs(rhs(z)): if lhs conjugates its argument, it conjugates rhs's matrix.
+    auto [a, b, c, d] = lhs.conjugate ?
+        std::array{ std::conj(rhs.a), std::conj(rhs.b), std::conj(rhs.c), std::conj(rhs.d) } :
+        std::array{ rhs.a, rhs.b, rhs.c, rhs.d };
+    return normalize(
+        lhs.a * a + lhs.b * c,
+        lhs.a * b + lhs.b * d,
+        lhs.c * a + lhs.d * c,
+        lhs.c * b + lhs.d * d,
+        lhs.conjugate != rhs.conjugate
+    );
+}
+
+ici::mobius ici::inverse(const mobius& m) {
+    // the adjugate inverts the matrix; an anti-Möbius map's inverse has it conjugated.
+    mobius adj{ m.d, -m.b, -m.c, m.a, m.conjugate };
+    if (m.conjugate) {
+        adj = { std::conj(adj.a), std::conj(adj.b), std::conj(adj.c), std::conj(adj.d), true };
+    }
+    return normalize(adj.a, adj.b, adj.c, adj.d, adj.conjugate);
+}
+
+std::optional<ici::circle> ici::apply(const mobius& m, const circle& c) {
+    // a circle with Hermitian form H maps to N^* H N, with N the inverse matrix, or to
+    // N^* conj(H) N for an anti-Möbius map.
+    complex center{ c.loc.x, c.loc.y };
+    hermitian h{ 1.0, -center, std::norm(center) - c.radius * c.radius };
+    if (m.conjugate) {
+        h.b = std::conj(h.b);
+    }
+    auto image = congruence(h, m.d, -m.b, -m.c, m.a);
+
+    // the image is a line when the quadratic coefficient vanishes.
+    auto scale = std::abs(image.a) + std::abs(image.b) + std::abs(image.d);
+    if (std::abs(image.a) <= std::numeric_limits<float>::epsilon() * scale) {
+        return {};
+    }
+    auto image_center = -image.b / image.a;
+    auto r_squ = std::norm(image_center) - image.d / image.a;
+    if (r_squ <= 0.0) {
+        return {};
+    }
+    return circle{ { image_center.real(), image_center.imag() }, std::sqrt(r_squ) };
+}
+
+ici::mobius ici::inversion_transform(const circle_word& word, std::span<const circle> seeds) {
+    return compose(
+        compose(word.transform, inversion_transform(seeds[word.seed])),
+        inverse(word.transform)
+    );
+}
+
+/*------------------------------------------------------------------------------------------------*/
+
+void ici::matrix_buffer::push_back(const mobius& m) {
+    a.push_back(m.a);
+    b.push_back(m.b);
+    c.push_back(m.c);
+    d.push_back(m.d);
+}
+
+void ici::matrix_buffer::push_back(const matrix_buffer& matrices, size_t i) {
+    a.push_back(matrices.a[i]);
+    b.push_back(matrices.b[i]);
+    c.push_back(matrices.c[i]);
+    d.push_back(matrices.d[i]);
+}
+
+void ici::matrix_buffer::clear() {
+    a.clear();
+    b.clear();
+    c.clear();
+    d.clear();
+}
+
+ici::mobius ici::matrix_buffer::get(size_t i, bool conjugate) const {
+    return { a[i], b[i], c[i], d[i], conjugate };
+}
+
+/*------------------------------------------------------------------------------------------------*/
+
+ici::word_buffer::word_buffer() {
+}
+
+ici::word_buffer::word_buffer(std::span<const circle_word> words, std::span<const circle> seeds) {
+    for (const auto& word : words) {
+        push_back(word, seeds);
+    }
+}
+
+void ici::word_buffer::push_back(const circle_word& word, std::span<const circle> seeds) {
+    transforms_.push_back(word.transform);
+    conjugate_.push_back(word.transform.conjugate);
+    seeds_.push_back(word.seed);
+    inversions_.push_back(inversion_transform(word, seeds));
+}
+
+void ici::word_buffer::push_back(const word_buffer& words, size_t i) {
+    transforms_.push_back(words.transforms_, i);
+    conjugate_.push_back(words.conjugate_[i]);
+    seeds_.push_back(words.seeds_[i]);
+    inversions_.push_back(words.inversions_, i);
+}
+
+void ici::word_buffer::clear() {
+    transforms_.clear();
+    conjugate_.clear();
+    seeds_.clear();
+    inversions_.clear();
+}
+
+ici::circle_word ici::word_buffer::operator[](size_t i) const {
+    return { transforms_.get(i, conjugate_[i]), seeds_[i] };
+}
+
+ici::mobius ici::word_buffer::inversion(size_t i) const {
+    return inversions_.get(i, true);
+}
+
+size_t ici::word_buffer::size() const {
+    return seeds_.size();
+}
+
+std::vector<ici::circle_word> ici::word_buffer::words() const {
+    std::vector<circle_word> words;
+    words.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        words.push_back((*this)[i]);
+    }
+    return words;
+}
+
+const ici::matrix_buffer& ici::word_buffer::transforms() const {
+    return transforms_;
+}
+
+const uint8_t* ici::word_buffer::conjugate() const {
+    return conjugate_.data();
+}
+
+const uint32_t* ici::word_buffer::seeds() const {
+    return seeds_.data();
+}
+
+const ici::matrix_buffer& ici::word_buffer::inversions() const {
+    return inversions_;
+}
+
+/*------------------------------------------------------------------------------------------------*/
+
+size_t ici::invert(const mobius& inversion, const word_buffer& invertees,
+        std::span<const circle> seeds, double min_radius, size_t offset,
+        std::vector<circle_word>& words, circle_buffer& output, std::vector<uint32_t>& sources) {
+    // the inverter's inversion is shared by the whole batch.
+    product_block products;
+    size_t lines = 0;
+    for (size_t first = 0; first < invertees.size(); first += k_block_size) {
+        auto n = std::min(k_block_size, invertees.size() - first);
+        compose_inversions(inversion, matrix_array(invertees.transforms(), first), n, products);
+        for (size_t i = 0; i < n; ++i) {
+            auto j = first + i;
+            circle_word image{
+                { products.a[i], products.b[i], products.c[i], products.d[i],
+                    !invertees.conjugate()[j] },
+                invertees.seeds()[j]
+            };
+            lines += append_image(image, seeds[image.seed], min_radius,
+                static_cast<uint32_t>(offset + j), words, output, sources);
+        }
+    }
+    return lines;
+}
+
+size_t ici::invert(const word_buffer& inverters, const circle_word& invertee,
+        std::span<const circle> seeds, double min_radius, size_t offset,
+        std::vector<circle_word>& words, circle_buffer& output, std::vector<uint32_t>& sources) {
+    // the invertee's transform is shared by the whole batch.
+    const auto& seed = seeds[invertee.seed];
+    product_block products;
+    size_t lines = 0;
+    for (size_t first = 0; first < inverters.size(); first += k_block_size) {
+        auto n = std::min(k_block_size, inverters.size() - first);
+        compose_inversions(matrix_array(inverters.inversions(), first), invertee.transform, n,
+            products);
+        for (size_t i = 0; i < n; ++i) {
+            circle_word image{
+                { products.a[i], products.b[i], products.c[i], products.d[i],
+                    !invertee.transform.conjugate },
+                invertee.seed
+            };
+            lines += append_image(image, seed, min_radius,
+                static_cast<uint32_t>(offset + first + i), words, output, sources);
+        }
+    }
+    return lines;
+}
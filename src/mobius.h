@@ -0,0 +1,101 @@
+#pragma once
+
+#include "geometry.h"
+#include "circle_buffer.h"
+#include <complex>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // a Möbius or anti-Möbius transformation z -> (a*w + b) / (c*w + d), where w is z, or
+    // conj(z) if conjugate is set. Inversion in a circle is anti-Möbius, so any word of
+    // inversions is one of these, and composing two of them is a 2x2 complex matrix product.
+    // Matrices are kept scaled to |ad - bc| = 1.
+
+    struct mobius {
+        std::complex<double> a;
+        std::complex<double> b;
+        std::complex<double> c;
+        std::complex<double> d;
+        bool conjugate;
+    };
+
+    mobius identity_transform();
+    mobius inversion_transform(const circle& c);
+    mobius compose(const mobius& lhs, const mobius& rhs);
+    mobius inverse(const mobius& m);
+    std::optional<circle> apply(const mobius& m, const circle& c);
+
+    // a generated circle represented as the image of a seed circle under a transformation.
+    struct circle_word {
+        mobius transform;
+        uint32_t seed;
+    };
+
+    // the inversion in the circle a word represents, T * s * T^-1 where s is inversion in
+    // the word's seed.
+    mobius inversion_transform(const circle_word& word, std::span<const circle> seeds);
+
+    // the matrices of transformations stored as a structure of arrays, one for each entry.
+    struct matrix_buffer {
+        std::vector<std::complex<double>> a;
+        std::vector<std::complex<double>> b;
+        std::vector<std::complex<double>> c;
+        std::vector<std::complex<double>> d;
+
+        void push_back(const mobius& m);
+        void push_back(const matrix_buffer& matrices, size_t i);
+        void clear();
+        mobius get(size_t i, bool conjugate) const;
+    };
+
+    // words stored as a structure of arrays, like circle_buffer, each with the inversion in
+    // the circle it represents, which is computed once, when the word is added, rather than
+    // for every pair the circle is inverted in. Inversions are anti-Möbius, so only their
+    // matrices are kept.
+
+    class word_buffer {
+        matrix_buffer transforms_;
+        std::vector<uint8_t> conjugate_;
+        std::vector<uint32_t> seeds_;
+        matrix_buffer inversions_;
+
+    public:
+        word_buffer();
+        word_buffer(std::span<const circle_word> words, std::span<const circle> seeds);
+
+        void push_back(const circle_word& word, std::span<const circle> seeds);
+        void push_back(const word_buffer& words, size_t i);
+        void clear();
+
+        circle_word operator[](size_t i) const;
+        mobius inversion(size_t i) const;
+        size_t size() const;
+        std::vector<circle_word> words() const;
+
+        const matrix_buffer& transforms() const;
+        const uint8_t* conjugate() const;
+        const uint32_t* seeds() const;
+        const matrix_buffer& inversions() const;
+    };
+
+    // batch inversion of words: each image word is the product of the inverter's inversion
+    // transform and the invertee's transform, and its circle is that product applied to the
+    // invertee's seed. The products are computed a block of pairs at a time, from the
+    // buffers' arrays, before any is applied. Images that are lines or smaller than
+    // min_radius are skipped. For each image appended to words and output, sources receives
+    // the index of the word in the batch it came from, plus offset. Returns how many of the
+    // skipped images were lines.
+
+    size_t invert(const mobius& inversion, const word_buffer& invertees,
+        std::span<const circle> seeds, double min_radius, size_t offset,
+        std::vector<circle_word>& words, circle_buffer& output, std::vector<uint32_t>& sources);
+    size_t invert(const word_buffer& inverters, const circle_word& invertee,
+        std::span<const circle> seeds, double min_radius, size_t offset,
+        std::vector<circle_word>& words, circle_buffer& output, std::vector<uint32_t>& sources);
+
+}
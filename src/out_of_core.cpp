@@ -0,0 +1,393 @@
+#include "out_of_core.h"
+#include "input.h"
+#include "circle_set.h"
+#include "circle_buffer.h"
+#include "inversion_kernel.h"
+#include "thread_pool.h"
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+#include <functional>
+#include <numeric>
+#include <algorithm>
+#include <random>
+#include <format>
+#include <print>
+#include <ranges>
+#include <span>
+
+namespace fs = std::filesystem;
+namespace r = std::ranges;
+namespace rv = std::ranges::views;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    using key = ici::circle_set::discretized_circle;
+    using key_set = std::unordered_set<key, ici::circle_set::hash_discretized_circle>;
+
+    // roughly what an unordered_set of discretized circles costs per element.
+    constexpr size_t k_bytes_per_key = 64;
+    constexpr size_t k_min_block_size = 1024;
+    constexpr size_t k_pairs_per_task = 4096;
+    constexpr size_t k_circles_per_sink_batch = 4096;
+    constexpr auto k_circles = "circles";
+    constexpr auto k_images = "images";
+
+    // bucket files are raw arrays of circles.
+    std::vector<ici::circle> read_block(std::ifstream& in, size_t block_size) {
+        std::vector<ici::circle> block(block_size);
+        in.read(reinterpret_cast<char*>(block.data()), block_size * sizeof(ici::circle));
+        block.resize(static_cast<size_t>(in.gcount()) / sizeof(ici::circle));
+        return block;
+    }
+
+    void append_circles(const fs::path& path, std::span<const ici::circle> circles) {
+        if (circles.empty()) {
+            return;
+        }
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        out.write(reinterpret_cast<const char*>(circles.data()), circles.size_bytes());
+        if (!out) {
+            throw std::runtime_error(std::format("unable to write {}", path.string()));
+        }
+    }
+
+    size_t circle_count(const fs::path& path) {
+        std::error_code ec;
+        auto size = fs::file_size(path, ec);
+        return ec ? 0 : static_cast<size_t>(size / sizeof(ici::circle));
+    }
+
+    // calls fn on each successive block of at most block_size circles of a file. A file
+    // that does not exist has no circles.
+    template<typename F>
+    void for_each_block(const fs::path& path, size_t block_size, F fn) {
+        std::ifstream in(path, std::ios::binary);
+        for (auto block = read_block(in, block_size); !block.empty();
+                block = read_block(in, block_size)) {
+            fn(block);
+        }
+    }
+
+    // the bucket of a key, when there are 2^bits of them: the top bits of its partition
+    // hash, so that doubling the buckets splits each in two.
+    size_t bucket_of(const key& k, int bits) {
+        auto h = ici::circle_set::partition_hash{}(k);
+        return (bits == 0) ? 0 : static_cast<size_t>(h >> (64 - bits));
+    }
+
+    // a directory of its own for a run's files, deleted along with them at the end of it.
+    class scratch_files {
+        fs::path dir_;
+
+    public:
+        scratch_files(const fs::path& parent) {
+            fs::create_directories(parent);
+            std::random_device rd;
+            do {
+                dir_ = parent / std::format("ici-{:08x}", rd());
+            } while (!fs::create_directory(dir_));
+        }
+
+        scratch_files(const scratch_files&) = delete;
+        scratch_files& operator=(const scratch_files&) = delete;
+
+        ~scratch_files() {
+            std::error_code ec;
+            fs::remove_all(dir_, ec);
+        }
+
+        const fs::path& dir() const {
+            return dir_;
+        }
+
+        // the circles first found by an iteration, in the order they were found.
+        fs::path generation(int gen) const {
+            return dir_ / std::format("generation-{}.bin", gen);
+        }
+
+        // bucket i of 2^bits, either of every circle found so far or of the images the
+        // current iteration found.
+        fs::path bucket(const char* kind, int bits, size_t i) const {
+            return dir_ / std::format("{}-{}-{}.bin", kind, bits, i);
+        }
+    };
+
+    // buffers circles bound for several files, writing them all out whenever capacity
+    // circles are buffered in all.
+    class bucket_writer {
+        std::function<fs::path(size_t)> file_;
+        std::vector<std::vector<ici::circle>> buffers_;
+        size_t capacity_;
+        size_t buffered_;
+
+    public:
+        bucket_writer(size_t buckets, size_t capacity, std::function<fs::path(size_t)> file) :
+                file_(std::move(file)), buffers_(buckets), capacity_(capacity), buffered_(0) {
+        }
+
+        void append(size_t bucket, const ici::circle& c) {
+            buffers_[bucket].push_back(c);
+            if (++buffered_ >= capacity_) {
+                flush();
+            }
+        }
+
+        void flush() {
+            for (auto i : rv::iota(size_t{ 0 }, buffers_.size())) {
+                append_circles(file_(i), buffers_[i]);
+                buffers_[i].clear();
+            }
+            buffered_ = 0;
+        }
+    };
+
+    struct disk_context {
+        ici::thread_pool& pool;
+        const ici::input& inp;
+        scratch_files files;
+        ici::circle_set keys; // empty; discretizes circles the same way an in-memory set does
+        size_t block_size;
+        size_t max_bucket_size;
+        int bits;
+        std::vector<size_t> generation_sizes;
+    };
+
+    struct pair_counts {
+        size_t pairs = 0;
+        size_t culled = 0;
+        size_t lines = 0;
+
+        pair_counts& operator+=(const pair_counts& counts) {
+            pairs += counts.pairs;
+            culled += counts.culled;
+            lines += counts.lines;
+            return *this;
+        }
+    };
+
+    size_t bucket_count(const disk_context& ctxt) {
+        return size_t{ 1 } << ctxt.bits;
+    }
+
+    // doubles the number of buckets, splitting bucket i into buckets 2i and 2i + 1.
+    void split_buckets(disk_context& ctxt) {
+        for (auto kind : { k_circles, k_images }) {
+            for (auto i : rv::iota(size_t{ 0 }, bucket_count(ctxt))) {
+                auto from = ctxt.files.bucket(kind, ctxt.bits, i);
+                bucket_writer halves(2, ctxt.block_size,
+                    [&](size_t half) { return ctxt.files.bucket(kind, ctxt.bits + 1, 2 * i + half); }
+                );
+                for_each_block(from, ctxt.block_size, [&](const auto& block) {
+                    for (const auto& c : block) {
+                        halves.append(bucket_of(ctxt.keys.discretize(c), ctxt.bits + 1) - 2 * i, c);
+                    }
+                });
+                halves.flush();
+                fs::remove(from);
+            }
+        }
+        ++ctxt.bits;
+    }
+
+    // inverts each row and the partners about each other, where a row's partners are all of
+    // them, or, if the partners are the rows themselves, the ones before it. The rows are
+    // split into tasks of about k_pairs_per_task pairs each, run on the pool a wave at a
+    // time, and each wave's images are written out in task order, so what is written does
+    // not depend on the number of threads.
+    pair_counts invert_block(disk_context& ctxt, std::span<const ici::circle> rows,
+            const ici::circle_buffer& partners, bool diagonal, bucket_writer& images) {
+        struct task_output {
+            ici::circle_buffer circles;
+            std::vector<uint32_t> sources;
+            size_t pairs;
+            size_t lines;
+        };
+
+        auto rows_per_task = std::max<size_t>(1, k_pairs_per_task / partners.size());
+        auto num_tasks = (rows.size() + rows_per_task - 1) / rows_per_task;
+        auto wave_size = static_cast<size_t>(ctxt.pool.size()) * 4;
+        std::vector<task_output> outputs(wave_size);
+        pair_counts counts;
+
+        for (size_t first = 0; first < num_tasks; first += wave_size) {
+            auto wave = std::min(wave_size, num_tasks - first);
+            ctxt.pool.parallel_for(wave, [&](size_t task) {
+                auto& out = outputs[task];
+                out.circles.clear();
+                out.sources.clear();
+                out.pairs = 0;
+                out.lines = 0;
+                auto begin = (first + task) * rows_per_task;
+                auto end = std::min(begin + rows_per_task, rows.size());
+                const auto& roi = ctxt.inp.roi;
+                for (auto i = begin; i < end; ++i) {
+                    auto n = diagonal ? i : partners.size();
+                    auto from = out.circles.size();
+                    out.lines += ici::invert(rows[i], partners, 0, n, ctxt.inp.min_radius,
+                        out.circles, out.sources);
+                    if (roi) {
+                        ici::cull_to_region(*roi, rows[i], true, partners,
+                            out.circles, out.sources, from);
+                    }
+                    from = out.circles.size();
+                    out.lines += ici::invert(partners, 0, n, rows[i], ctxt.inp.min_radius,
+                        out.circles, out.sources);
+                    if (roi) {
+                        ici::cull_to_region(*roi, rows[i], false, partners,
+                            out.circles, out.sources, from);
+                    }
+                    out.pairs += n;
+                }
+            });
+            for (const auto& out : outputs | rv::take(wave)) {
+                counts.pairs += out.pairs;
+                counts.culled += 2 * out.pairs - out.circles.size() - out.lines;
+                counts.lines += out.lines;
+                for (auto i : rv::iota(size_t{ 0 }, out.circles.size())) {
+                    auto c = out.circles[i];
+                    images.append(bucket_of(ctxt.keys.discretize(c), ctxt.bits), c);
+                }
+            }
+        }
+
+        return counts;
+    }
+
+    // inverts the rows of generation gen, each of its circles paired with every circle
+    // found before it, and writes the images to the image buckets. Only a block of the
+    // generation and a block of the earlier circles are in memory at once.
+    pair_counts invert_generation(disk_context& ctxt, int gen) {
+        bucket_writer images(bucket_count(ctxt), 4 * ctxt.block_size,
+            [&](size_t i) { return ctxt.files.bucket(k_images, ctxt.bits, i); }
+        );
+        pair_counts counts;
+
+        std::ifstream in(ctxt.files.generation(gen), std::ios::binary);
+        size_t offset = 0;
+        for (auto rows = read_block(in, ctxt.block_size); !rows.empty();
+                rows = read_block(in, ctxt.block_size)) {
+            for (int older : rv::iota(0, gen)) {
+                for_each_block(ctxt.files.generation(older), ctxt.block_size,
+                    [&](const auto& block) {
+                        counts += invert_block(ctxt, rows, ici::circle_buffer(block), false, images);
+                    }
+                );
+            }
+            std::ifstream earlier(ctxt.files.generation(gen), std::ios::binary);
+            for (size_t i = 0; i < offset; i += ctxt.block_size) {
+                counts += invert_block(
+                    ctxt, rows, ici::circle_buffer(read_block(earlier, ctxt.block_size)), false, images
+                );
+            }
+            counts += invert_block(ctxt, rows, ici::circle_buffer(rows), true, images);
+            offset += rows.size();
+        }
+
+        images.flush();
+        return counts;
+    }
+
+    struct dedup_result {
+        size_t added;
+        double largest_in_view;
+    };
+
+    // moves the images found by an iteration into the circle buckets, dropping those already
+    // in them, and writes the ones that are new to the file of generation gen. Only one
+    // bucket's keys are in memory at a time, so the buckets are split first if all the
+    // circles and images spread across them could fill one past its share of the budget.
+    dedup_result deduplicate(disk_context& ctxt, int gen) {
+        auto total = std::accumulate(ctxt.generation_sizes.begin(), ctxt.generation_sizes.end(), size_t{ 0 });
+        for (auto i : rv::iota(size_t{ 0 }, bucket_count(ctxt))) {
+            total += circle_count(ctxt.files.bucket(k_images, ctxt.bits, i));
+        }
+        while ((total >> ctxt.bits) > ctxt.max_bucket_size) {
+            split_buckets(ctxt);
+        }
+
+        dedup_result result{ 0, 0.0 };
+        for (auto i : rv::iota(size_t{ 0 }, bucket_count(ctxt))) {
+            auto circles = ctxt.files.bucket(k_circles, ctxt.bits, i);
+            auto images = ctxt.files.bucket(k_images, ctxt.bits, i);
+
+            key_set keys;
+            for_each_block(circles, ctxt.block_size, [&](const auto& block) {
+                for (const auto& c : block) {
+                    keys.insert(ctxt.keys.discretize(c));
+                }
+            });
+            std::vector<ici::circle> added;
+            for_each_block(images, ctxt.block_size, [&](const auto& block) {
+                for (const auto& c : block) {
+                    if (keys.insert(ctxt.keys.discretize(c)).second) {
+                        added.push_back(c);
+                    }
+                }
+            });
+            fs::remove(images);
+
+            if (ctxt.inp.auto_stop) {
+                for (const auto& c : added) {
+                    if (c.radius > result.largest_in_view &&
+                            ici::circle_rectangle_intersection(c, ctxt.inp.auto_stop->view)) {
+                        result.largest_in_view = c.radius;
+                    }
+                }
+            }
+            append_circles(circles, added);
+            append_circles(ctxt.files.generation(gen), added);
+            result.added += added.size();
+        }
+
+        ctxt.generation_sizes.push_back(result.added);
+        return result;
+    }
+
+    void emit_generation(const disk_context& ctxt, int gen, const ici::circle_sink& sink) {
+        for_each_block(ctxt.files.generation(gen), k_circles_per_sink_batch, sink);
+    }
+}
+
+void ici::generate_out_of_core(thread_pool& pool, const input& inp, const circle_sink& sink) {
+    // a quarter of the budget is for the two blocks of circles being paired, each held both
+    // as circles and as a circle buffer, a quarter for buffered images, and half for the keys
+    // of the bucket being deduplicated.
+    disk_context ctxt{
+        pool, inp, scratch_files(inp.scratch_dir), circle_set(inp.eps, inp.tolerance),
+        std::max(k_min_block_size, static_cast<size_t>(inp.memory_budget / 16 / sizeof(circle))),
+        std::max(k_min_block_size, static_cast<size_t>(inp.memory_budget / 2 / k_bytes_per_key)),
+        0, {}
+    };
+    std::println("  keeping circles on disk in {}, {} MB in memory",
+        ctxt.files.dir().string(), inp.memory_budget / (1024 * 1024)
+    );
+
+    // the seeds are the images of iteration zero.
+    append_circles(ctxt.files.bucket(k_images, 0, 0), inp.circles);
+    deduplicate(ctxt, 0);
+    emit_generation(ctxt, 0, sink);
+
+    for (int i : rv::iota(0, inp.iterations)) {
+        auto counts = invert_generation(ctxt, i);
+        auto [added, largest] = deduplicate(ctxt, i + 1);
+        std::println("  iteration {}: {} inversions, {} culled, {} lines, "
+            "adding {} circles in {} buckets...",
+            i + 1, 2 * counts.pairs, counts.culled, counts.lines, added, bucket_count(ctxt)
+        );
+        emit_generation(ctxt, i + 1, sink);
+        if (added == 0) {
+            std::println("  closed under inversion.");
+            break;
+        }
+        if (inp.auto_stop) {
+            std::println("    largest new circle in view has radius {}", largest);
+            if (largest < inp.auto_stop->radius) {
+                std::println("  new circles are too small to show, stopping.");
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "geometry.h"
+#include "iterated_inversion.h"
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    struct input;
+    class thread_pool;
+
+    // closure generation with the circles kept on disk instead of in memory, for runs whose
+    // circles outgrow it. Circles are hash partitioned by their discretized key into bucket
+    // files, so each bucket can be deduplicated on its own, and the number of buckets doubles
+    // whenever one would no longer fit in the input's memory budget. Each iteration's new
+    // circles are written to a file of their own, and the pairs of the next iteration are
+    // inverted a block of that file against a block of the older files at a time. The
+    // circles match closure mode's up to eps: of images with the same key, a bucket keeps
+    // the first in its file, not the one closure mode would. Symmetry is not used. Circles
+    // are passed to sink an iteration at a time, read back from their files, since
+    // collecting them all in memory would defeat the purpose.
+
+    void generate_out_of_core(thread_pool& pool, const input& inp, const circle_sink& sink);
+
+}
@@ -0,0 +1,413 @@
+#include "sharded_generation.h"
+#include "worker_process.h"
+#include "input.h"
+#include "util.h"
+#include "circle_set.h"
+#include "circle_buffer.h"
+#include "inversion_kernel.h"
+#include <sstream>
+#include <memory>
+#include <format>
+#include <print>
+#include <ranges>
+#include <span>
+#include <optional>
+#include <algorithm>
+
+namespace r = std::ranges;
+namespace rv = std::ranges::views;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr int k_stdin = 0;
+    constexpr int k_stdout = 1;
+    constexpr size_t k_circles_per_sink_batch = 4096;
+
+    // the new circles of an iteration go to the workers in blocks of as many as pair with
+    // about this many circles of a shard, which bounds the images a worker holds at once.
+    constexpr size_t k_pairs_per_block = size_t{ 1 } << 20;
+
+    // the coordinator sends a worker its settings once and each shard its seeds to insert,
+    // then, each iteration, every worker the new circles a block at a time. For each block
+    // every worker sends each of the others the images it found that are in their shards,
+    // and after the last block answers with the circles its shard found new. A worker that
+    // fails answers whatever it was sent with an error.
+    enum class message_type : uint32_t {
+        settings,
+        insert,
+        inserted,
+        block,
+        images,
+        stop,
+        error
+    };
+
+    struct worker_settings {
+        double eps;
+        ici::tolerance_scale tolerance;
+        double min_radius;
+        std::optional<ici::region_of_interest> roi;
+        uint32_t shard;
+        uint32_t shards;
+        ici::peer_channels peers;
+    };
+
+    // the settings are written field by field, so that no padding goes over the pipe.
+    ici::message settings_message(const worker_settings& settings) {
+        std::ostringstream out;
+        ici::write_binary(out, settings.eps);
+        ici::write_binary(out, settings.tolerance);
+        ici::write_binary(out, settings.min_radius);
+        ici::write_binary(out, static_cast<uint8_t>(settings.roi.has_value()));
+        if (settings.roi) {
+            ici::write_binary(out, settings.roi->view);
+            ici::write_binary(out, settings.roi->error);
+            ici::write_binary(out, settings.roi->pruning);
+        }
+        ici::write_binary(out, settings.shard);
+        ici::write_binary(out, settings.shards);
+        ici::write_binary(out, settings.peers.from);
+        ici::write_binary(out, settings.peers.to);
+        return { static_cast<uint32_t>(message_type::settings), out.str() };
+    }
+
+    worker_settings read_settings(std::istream& in) {
+        worker_settings settings{};
+        settings.eps = ici::read_binary<double>(in);
+        settings.tolerance = ici::read_binary<ici::tolerance_scale>(in);
+        settings.min_radius = ici::read_binary<double>(in);
+        if (ici::read_binary<uint8_t>(in)) {
+            ici::region_of_interest roi{};
+            roi.view = ici::read_binary<ici::rectangle>(in);
+            roi.error = ici::read_binary<double>(in);
+            roi.pruning = ici::read_binary<ici::roi_pruning>(in);
+            settings.roi = roi;
+        }
+        settings.shard = ici::read_binary<uint32_t>(in);
+        settings.shards = ici::read_binary<uint32_t>(in);
+        settings.peers.from = ici::read_binary_vector<int>(in);
+        settings.peers.to = ici::read_binary_vector<int>(in);
+        return settings;
+    }
+
+    template<typename... Ts>
+    ici::message make_message(message_type type, const Ts&... values) {
+        std::ostringstream out;
+        (ici::write_binary(out, values), ...);
+        return { static_cast<uint32_t>(type), out.str() };
+    }
+
+    // the payload of a message, which must be of the expected type.
+    std::istringstream payload(const ici::message& msg, message_type expected) {
+        if (msg.type == static_cast<uint32_t>(message_type::error)) {
+            throw std::runtime_error(std::format("worker failed: {}", msg.payload));
+        }
+        if (msg.type != static_cast<uint32_t>(expected)) {
+            throw std::runtime_error(std::format("unexpected message of type {}", msg.type));
+        }
+        return std::istringstream(msg.payload);
+    }
+
+    size_t shard_of(const ici::circle_set& set, const ici::circle& c, size_t shards) {
+        return static_cast<size_t>(ici::circle_set::partition_hash{}(set.discretize(c)) % shards);
+    }
+
+    /*--------------------------------------------------------------------------------------------*/
+
+    // a worker: the shard of the circles whose keys hash to it. Every circle found before
+    // the current iteration is in exactly one shard, so inverting each new circle about the
+    // circles of every shard, and each of those about it, covers every pair once, provided
+    // each pair of new circles is only taken in one order. The new circles arrive in
+    // generation order, which lists each shard's new circles together, from own_begin on.
+    class shard_worker {
+        worker_settings settings_;
+        ici::circle_set shard_;
+
+        // the shard's circles from the previous iteration, and where this iteration's begin.
+        size_t own_from_ = 0;
+        size_t own_to_ = 0;
+        size_t inserting_from_ = 0;
+
+        std::vector<ici::circle> added_;
+        uint64_t pairs_ = 0;
+        uint64_t culled_ = 0;
+        uint64_t lines_ = 0;
+
+        // the images of circle x, at position i of the generation, about the circles of the
+        // shard it pairs with, and theirs about it, added to images by shard.
+        void invert(const ici::circle& x, size_t i, size_t own_begin,
+                std::vector<std::vector<ici::circle>>& images, ici::circle_buffer& out,
+                std::vector<uint32_t>& sources) {
+            const auto& circles = shard_.circles();
+            auto end = own_from_ + std::min(own_to_ - own_from_, i - std::min(i, own_begin));
+            out.clear();
+            sources.clear();
+            size_t lines = ici::invert(x, circles, 0, end, settings_.min_radius, out, sources);
+            if (settings_.roi) {
+                ici::cull_to_region(*settings_.roi, x, true, circles, out, sources, 0);
+            }
+            auto from = out.size();
+            lines += ici::invert(circles, 0, end, x, settings_.min_radius, out, sources);
+            if (settings_.roi) {
+                ici::cull_to_region(*settings_.roi, x, false, circles, out, sources, from);
+            }
+            pairs_ += end;
+            culled_ += 2 * end - out.size() - lines;
+            lines_ += lines;
+            for (auto j : rv::iota(size_t{ 0 }, out.size())) {
+                images[shard_of(shard_, out[j], settings_.shards)].push_back(out[j]);
+            }
+        }
+
+    public:
+        explicit shard_worker(worker_settings settings) :
+            settings_(std::move(settings)),
+            shard_(settings_.eps, settings_.tolerance) {
+        }
+
+        void insert(std::span<const ici::circle> circles) {
+            for (const auto& c : circles) {
+                if (shard_.insert(c).second) {
+                    added_.push_back(c);
+                }
+            }
+        }
+
+        // the pair, culled and line counts and the circles found new since the last call.
+        ici::message take_inserted() {
+            auto msg = make_message(message_type::inserted, pairs_, culled_, lines_, added_);
+            added_.clear();
+            pairs_ = 0;
+            culled_ = 0;
+            lines_ = 0;
+            return msg;
+        }
+
+        // inverts a block of the new circles that starts at position block_begin of the
+        // generation, passes every other worker the images in its shard, and inserts the
+        // images in this one, from every worker in order, its own included.
+        void invert_block(std::span<const ici::circle> block, size_t block_begin,
+                size_t own_begin) {
+            if (block_begin == 0) {
+                own_from_ = inserting_from_;
+                own_to_ = shard_.size();
+                inserting_from_ = shard_.size();
+            }
+            std::vector<std::vector<ici::circle>> images(settings_.shards);
+            ici::circle_buffer out;
+            std::vector<uint32_t> sources;
+            for (size_t k = 0; k < block.size(); ++k) {
+                invert(block[k], block_begin + k, own_begin, images, out, sources);
+            }
+
+            std::vector<int> to;
+            std::vector<int> from;
+            std::vector<ici::message> outgoing;
+            for (size_t p = 0; p < settings_.shards; ++p) {
+                if (p != settings_.shard) {
+                    to.push_back(settings_.peers.to[p]);
+                    from.push_back(settings_.peers.from[p]);
+                    outgoing.push_back(make_message(message_type::images, images[p]));
+                    images[p] = {};
+                }
+            }
+            auto received = ici::exchange_messages(to, outgoing, from);
+            for (size_t p = 0, q = 0; p < settings_.shards; ++p) {
+                if (p == settings_.shard) {
+                    insert(images[p]);
+                    continue;
+                }
+                auto in = payload(received[q++], message_type::images);
+                insert(ici::read_binary_vector<ici::circle>(in));
+            }
+        }
+    };
+
+    /*--------------------------------------------------------------------------------------------*/
+
+    struct shard_counts {
+        uint64_t pairs = 0;
+        uint64_t culled = 0;
+        uint64_t lines = 0;
+    };
+
+    class worker_group {
+        std::vector<std::unique_ptr<ici::worker_process>> workers_;
+
+        // where each shard's new circles begin in the current generation.
+        std::vector<size_t> own_begins_;
+
+        // collects the circles each shard found new, shard by shard.
+        std::vector<ici::circle> collect_inserted(shard_counts& counts) {
+            std::vector<ici::circle> added;
+            own_begins_.clear();
+            for (const auto& worker : workers_) {
+                auto in = payload(worker->receive(), message_type::inserted);
+                counts.pairs += ici::read_binary<uint64_t>(in);
+                counts.culled += ici::read_binary<uint64_t>(in);
+                counts.lines += ici::read_binary<uint64_t>(in);
+                auto shard_added = ici::read_binary_vector<ici::circle>(in);
+                own_begins_.push_back(added.size());
+                added.insert(added.end(), shard_added.begin(), shard_added.end());
+            }
+            return added;
+        }
+
+    public:
+        worker_group(const ici::input& inp, size_t count) {
+            std::vector<ici::peer_channels> channels;
+            workers_ = ici::start_workers(count, channels);
+            for (auto shard : rv::iota(size_t{ 0 }, count)) {
+                worker_settings settings{
+                    inp.eps, inp.tolerance, inp.min_radius, inp.roi,
+                    static_cast<uint32_t>(shard), static_cast<uint32_t>(count),
+                    channels[shard]
+                };
+                workers_[shard]->send(settings_message(settings));
+            }
+        }
+
+        ~worker_group() {
+            for (const auto& worker : workers_) {
+                try {
+                    worker->send(make_message(message_type::stop));
+                } catch (...) {
+                }
+            }
+        }
+
+        size_t size() const {
+            return workers_.size();
+        }
+
+        // passes each shard its circles and returns the ones that were new, shard by shard.
+        std::vector<ici::circle> insert(const std::vector<std::vector<ici::circle>>& circles) {
+            for (auto shard : rv::iota(size_t{ 0 }, workers_.size())) {
+                workers_[shard]->send(make_message(message_type::insert, circles[shard]));
+            }
+            shard_counts counts;
+            return collect_inserted(counts);
+        }
+
+        // passes every worker the new circles, the last ones returned, a block at a time, and
+        // returns the images the shards found new, shard by shard. The images go straight
+        // from the workers that find them to the ones that own their shards.
+        std::vector<ici::circle> invert(const std::vector<ici::circle>& circles,
+                size_t total, shard_counts& counts) {
+            auto per_shard = (total + workers_.size() - 1) / workers_.size();
+            auto block_sz = std::max<size_t>(1, k_pairs_per_block / std::max<size_t>(1, per_shard));
+            for (size_t begin = 0; begin < circles.size(); begin += block_sz) {
+                auto end = std::min(circles.size(), begin + block_sz);
+                std::vector<ici::circle> block(circles.begin() + begin, circles.begin() + end);
+                for (auto shard : rv::iota(size_t{ 0 }, workers_.size())) {
+                    workers_[shard]->send(make_message(message_type::block,
+                        static_cast<uint64_t>(begin), static_cast<uint64_t>(own_begins_[shard]),
+                        static_cast<uint8_t>(end == circles.size()), block
+                    ));
+                }
+            }
+            return collect_inserted(counts);
+        }
+    };
+
+    void emit(const ici::circle_sink* sink, std::span<const ici::circle> circles) {
+        if (!sink) {
+            return;
+        }
+        for (size_t i = 0; i < circles.size(); i += k_circles_per_sink_batch) {
+            (*sink)(circles.subspan(i, std::min(k_circles_per_sink_batch, circles.size() - i)));
+        }
+    }
+}
+
+std::vector<ici::circle> ici::generate_sharded(const input& inp, const circle_sink* sink) {
+    std::println("  sharding circles across {} worker processes", inp.worker_processes);
+    sigpipe_ignored ignoring;
+    worker_group workers(inp, inp.worker_processes);
+    circle_set keys(inp.eps, inp.tolerance); // empty; discretizes circles the same way the shards do
+
+    std::vector<std::vector<circle>> seeds(workers.size());
+    for (const auto& c : inp.circles) {
+        seeds[shard_of(keys, c, workers.size())].push_back(c);
+    }
+    auto circles = workers.insert(seeds);
+    size_t total = 0;
+    emit(sink, circles);
+
+    std::vector<circle> output = sink ? std::vector<circle>{} : circles;
+    for (int i : rv::iota(0, inp.iterations)) {
+        if (circles.empty()) {
+            std::println("  closed under inversion.");
+            break;
+        }
+        shard_counts counts;
+        total += circles.size();
+        circles = workers.invert(circles, total, counts);
+
+        std::println("  iteration {}: {} inversions, {} culled, {} lines, adding {} circles...",
+            i + 1, 2 * counts.pairs, counts.culled, counts.lines, circles.size()
+        );
+        emit(sink, circles);
+        if (!sink) {
+            output.insert(output.end(), circles.begin(), circles.end());
+        }
+        if (inp.auto_stop && !circles.empty()) {
+            double largest = 0.0;
+            for (const auto& c : circles) {
+                if (c.radius > largest && circle_rectangle_intersection(c, inp.auto_stop->view)) {
+                    largest = c.radius;
+                }
+            }
+            std::println("    largest new circle in view has radius {}", largest);
+            if (largest < inp.auto_stop->radius) {
+                std::println("  new circles are too small to show, stopping.");
+                break;
+            }
+        }
+    }
+
+    return output;
+}
+
+int ici::run_worker() {
+    sigpipe_ignored ignoring;
+    try {
+        auto in = payload(receive_message(k_stdin), message_type::settings);
+        shard_worker worker(read_settings(in));
+
+        for (;;) {
+            auto msg = receive_message(k_stdin);
+            switch (static_cast<message_type>(msg.type)) {
+                case message_type::insert: {
+                    auto in = payload(msg, message_type::insert);
+                    worker.insert(read_binary_vector<circle>(in));
+                    send_message(k_stdout, worker.take_inserted());
+                    break;
+                }
+                case message_type::block: {
+                    auto in = payload(msg, message_type::block);
+                    auto block_begin = read_binary<uint64_t>(in);
+                    auto own_begin = read_binary<uint64_t>(in);
+                    auto last = read_binary<uint8_t>(in) != 0;
+                    worker.invert_block(read_binary_vector<circle>(in), block_begin, own_begin);
+                    if (last) {
+                        send_message(k_stdout, worker.take_inserted());
+                    }
+                    break;
+                }
+                case message_type::stop:
+                    return 0;
+                default:
+                    throw std::runtime_error(std::format("unexpected message of type {}", msg.type));
+            }
+        }
+    } catch (const std::exception& e) {
+        try {
+            send_message(k_stdout, { static_cast<uint32_t>(message_type::error), e.what() });
+        } catch (...) {
+        }
+        return -1;
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "geometry.h"
+#include "iterated_inversion.h"
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    struct input;
+
+    // closure generation split across worker processes. Each worker owns the shard of the
+    // deduplicating set that their discretized keys hash to and keeps only the circles in it.
+    // Each iteration, this process streams the new circles to every worker a block at a time;
+    // each worker inverts the block against its shard, sends the images straight to the
+    // workers that own their shards over pipes between the workers, and inserts the ones it
+    // is sent. The circles the shards report as new make up the next generation. Symmetry is
+    // not used. If sink is set, circles are passed to it an iteration at a time and the
+    // returned vector is empty.
+
+    std::vector<circle> generate_sharded(const input& inp, const circle_sink* sink);
+
+    // the main loop of a worker process, which reads messages from its standard input and
+    // answers them on its standard output. Returns the process's exit code.
+    int run_worker();
+
+}
@@ -0,0 +1,180 @@
+#include "symmetry.h"
+#include <complex>
+#include <numbers>
+#include <ranges>
+#include <cmath>
+
+namespace r = std::ranges;
+namespace rv = std::ranges::views;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr auto k_two_pi = 2.0 * std::numbers::pi;
+
+    std::complex<double> offset(const ici::point& center, const ici::point& pt) {
+        return { pt.x - center.x, pt.y - center.y };
+    }
+
+    ici::circle from_offset(const ici::point& center, std::complex<double> z, double radius) {
+        return { {center.x + z.real(), center.y + z.imag()}, radius };
+    }
+
+    // whether transform maps every circle onto some circle of the set, to within eps.
+    template<typename F>
+    bool is_symmetry(const std::vector<ici::circle>& circles, double eps, F transform) {
+        return r::all_of(circles,
+            [&](const ici::circle& c) {
+                auto image = transform(c);
+                return r::any_of(circles,
+                    [&](const ici::circle& d) {
+                        return std::abs(image.loc.x - d.loc.x) < eps &&
+                            std::abs(image.loc.y - d.loc.y) < eps &&
+                            std::abs(image.radius - d.radius) < eps;
+                    }
+                );
+            }
+        );
+    }
+
+    ici::circle rotate(const ici::point& center, const ici::circle& c, double theta) {
+        return from_offset(center, offset(center, c.loc) * std::polar(1.0, theta), c.radius);
+    }
+
+    // reflects across the line through center at angle axis.
+    ici::circle reflect(const ici::point& center, const ici::circle& c, double axis) {
+        return from_offset(
+            center, std::polar(1.0, 2.0 * axis) * std::conj(offset(center, c.loc)), c.radius
+        );
+    }
+}
+
+ici::symmetry_group::symmetry_group() : symmetry_group({ 0, 0 }, 1, false, 0.0) {
+}
+
+ici::symmetry_group::symmetry_group(const point& center, int order, bool dihedral, double axis) :
+        center_(center), order_(order), dihedral_(dihedral), axis_(axis) {
+    // rotations first, then the rotations composed with the reflection across the axis.
+    for (int reflected = 0; reflected <= (dihedral ? 1 : 0); ++reflected) {
+        for (int i = 0; i < order; ++i) {
+            auto rot = std::polar(1.0, i * k_two_pi / order);
+            if (!reflected) {
+                elements_.push_back({ rot.real(), -rot.imag(), rot.imag(), rot.real() });
+            } else {
+                auto refl = rot * std::polar(1.0, 2.0 * axis);
+                elements_.push_back({ refl.real(), refl.imag(), refl.imag(), -refl.real() });
+            }
+        }
+    }
+}
+
+bool ici::symmetry_group::trivial() const {
+    return elements_.size() == 1;
+}
+
+int ici::symmetry_group::order() const {
+    return order_;
+}
+
+bool ici::symmetry_group::dihedral() const {
+    return dihedral_;
+}
+
+size_t ici::symmetry_group::size() const {
+    return elements_.size();
+}
+
+ici::circle ici::symmetry_group::apply(size_t element, const circle& c) const {
+    const auto& [a, b, c2, d] = elements_[element];
+    auto x = c.loc.x - center_.x;
+    auto y = c.loc.y - center_.y;
+    return {
+        { center_.x + a * x + b * y, center_.y + c2 * x + d * y },
+        c.radius
+    };
+}
+
+ici::circle ici::symmetry_group::canonical(const circle& c, double eps) const {
+    auto z = offset(center_, c.loc);
+    auto mag = std::abs(z);
+    if (trivial() || mag < eps) {
+        return c;
+    }
+
+    // circles within eps of the end of the wedge belong to the start of the next one, so
+    // that a circle on a boundary always has the same representative.
+    auto wedge = k_two_pi / order_;
+    auto tolerance = eps / mag;
+    auto theta = std::fmod(std::arg(z) - axis_ + 2.0 * k_two_pi, k_two_pi);
+    auto sector = std::floor((theta + tolerance) / wedge);
+    z *= std::polar(1.0, -sector * wedge);
+
+    // the angle within the wedge comes from the reduced angle rather than from std::arg,
+    // whose range of (-pi, pi] would never reach past half of the whole-turn wedge of a
+    // group that is only a mirror.
+    if (dihedral_) {
+        auto phi = theta - sector * wedge;
+        if (phi > wedge / 2.0 + tolerance) {
+            z = std::polar(1.0, 2.0 * axis_ + wedge) * std::conj(z);
+        }
+    }
+
+    return from_offset(center_, z, c.radius);
+}
+
+std::vector<ici::circle> ici::symmetry_group::orbit(const circle& c) const {
+    return rv::iota(size_t{ 0 }, size()) | rv::transform(
+            [&](size_t i) { return apply(i, c); }
+        ) | r::to<std::vector>();
+}
+
+ici::symmetry_group ici::detect_symmetry(const std::vector<circle>& circles, double eps) {
+    if (circles.empty()) {
+        return {};
+    }
+
+    // any symmetry of the set fixes the centroid of the circles' centers.
+    point center{ 0, 0 };
+    for (const auto& c : circles) {
+        center = center + c.loc;
+    }
+    center = (1.0 / circles.size()) * center;
+
+    auto off_center = circles | rv::filter(
+            [&](const circle& c) { return distance(c.loc, center) >= eps; }
+        ) | r::to<std::vector>();
+    if (off_center.empty()) {
+        return {};
+    }
+
+    // each off-center circle has an orbit of exactly order circles under the rotations, so
+    // the largest candidate is the number of off-center circles.
+    auto n = static_cast<int>(off_center.size());
+    int order = 1;
+    for (int k = n; k >= 2; --k) {
+        if (n % k != 0) {
+            continue;
+        }
+        auto theta = k_two_pi / k;
+        if (is_symmetry(circles, eps, [&](auto&& c) { return rotate(center, c, theta); })) {
+            order = k;
+            break;
+        }
+    }
+
+    // a reflection maps the first off-center circle onto some off-center circle, and the
+    // axis then bisects their angles.
+    auto first_angle = std::arg(offset(center, off_center.front().loc));
+    for (const auto& c : off_center) {
+        auto axis = (first_angle + std::arg(offset(center, c.loc))) / 2.0;
+        if (is_symmetry(circles, eps, [&](auto&& c) { return reflect(center, c, axis); })) {
+            return { center, order, true, axis };
+        }
+    }
+
+    if (order == 1) {
+        return {};
+    }
+    return { center, order, false, first_angle };
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "geometry.h"
+#include <vector>
+#include <array>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // a finite symmetry group of the plane about a center: the rotations by multiples of
+    // 2*pi/order and, if the group is dihedral, the reflections across the lines through the
+    // center at axis + k*pi/order. The fundamental domain is the wedge of angles
+    // [axis, axis + 2*pi/order), or [axis, axis + pi/order] for a dihedral group, and every
+    // circle has exactly one image under the group whose center lies in it.
+
+    class symmetry_group {
+        using linear_map = std::array<double, 4>;
+
+        point center_;
+        int order_;
+        bool dihedral_;
+        double axis_;
+        std::vector<linear_map> elements_;
+
+    public:
+        symmetry_group();
+        symmetry_group(const point& center, int order, bool dihedral, double axis);
+
+        bool trivial() const;
+        int order() const;
+        bool dihedral() const;
+        size_t size() const;
+
+        circle apply(size_t element, const circle& c) const;
+        circle canonical(const circle& c, double eps) const;
+        std::vector<circle> orbit(const circle& c) const;
+    };
+
+    symmetry_group detect_symmetry(const std::vector<circle>& circles, double eps);
+}
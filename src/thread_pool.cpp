@@ -0,0 +1,90 @@
+#include "thread_pool.h"
+
+/*------------------------------------------------------------------------------------------------*/
+
+ici::thread_pool::thread_pool(int num_threads) : active_(0), stopping_(false) {
+    // a pool of one thread runs everything inline on the calling thread.
+    if (num_threads <= 1) {
+        return;
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+ici::thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    task_available_.notify_all();
+    workers_.clear();
+}
+
+void ici::thread_pool::run_task(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (...) {
+        std::lock_guard lock(mutex_);
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+    }
+}
+
+void ici::thread_pool::worker_loop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex_);
+            task_available_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            ++active_;
+        }
+
+        run_task(task);
+
+        {
+            std::lock_guard lock(mutex_);
+            --active_;
+            if (active_ == 0 && tasks_.empty()) {
+                idle_.notify_all();
+            }
+        }
+    }
+}
+
+void ici::thread_pool::post(std::function<void()> task) {
+    if (workers_.empty()) {
+        run_task(task);
+        return;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    task_available_.notify_one();
+}
+
+void ici::thread_pool::wait() {
+    std::unique_lock lock(mutex_);
+    idle_.wait(lock, [this]() { return active_ == 0 && tasks_.empty(); });
+    if (error_) {
+        auto error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+int ici::thread_pool::size() const {
+    return workers_.empty() ? 1 : static_cast<int>(workers_.size());
+}
+
+int ici::default_thread_count() {
+    auto n = static_cast<int>(std::thread::hardware_concurrency());
+    return (n > 0) ? n : 1;
+}
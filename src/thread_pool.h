@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    class thread_pool {
+
+        std::vector<std::jthread> workers_;
+        std::deque<std::function<void()>> tasks_;
+        std::mutex mutex_;
+        std::condition_variable task_available_;
+        std::condition_variable idle_;
+        size_t active_;
+        bool stopping_;
+        std::exception_ptr error_;
+
+        void worker_loop();
+        void run_task(const std::function<void()>& task);
+
+    public:
+        thread_pool(int num_threads);
+        ~thread_pool();
+
+        void post(std::function<void()> task);
+        void wait();
+        int size() const;
+
+        template<typename F>
+        void parallel_for(size_t n, F&& fn) {
+            for (size_t i = 0; i < n; ++i) {
+                post([&fn, i]() { fn(i); });
+            }
+            wait();
+        }
+    };
+
+    int default_thread_count();
+}
@@ -4,6 +4,8 @@
 #include <ranges>
 #include <sstream>
 #include <format>
+#include <cmath>
+#include <algorithm>
 
 namespace r = std::ranges;
 namespace rv = std::ranges::views;
@@ -16,3 +18,25 @@ void ici::string_to_file(const std::string& fname, const std::string& contents)
     file << contents;
 }
 
+
+size_t ici::two_combinations_count(size_t n) {
+    return (n < 2) ? 0 : (n * (n - 1)) / 2;
+}
+
+std::tuple<size_t, size_t> ici::nth_two_combination(size_t n, size_t k) {
+    // row i of the triangular pair space holds the pairs (i, i+1) ... (i, n-1) and
+    // starts at linear index i*n - i*(i+1)/2. Solve for i in closed form, then
+    // correct for floating point error.
+    auto row_start = [n](size_t i) { return i * n - (i * (i + 1)) / 2; };
+    auto m = static_cast<double>(2 * n - 1);
+    auto i = static_cast<size_t>(
+        std::max(0.0, std::floor((m - std::sqrt(m * m - 8.0 * static_cast<double>(k))) / 2.0))
+    );
+    while (i > 0 && row_start(i) > k) {
+        --i;
+    }
+    while (row_start(i + 1) <= k) {
+        ++i;
+    }
+    return { i, i + 1 + (k - row_start(i)) };
+}
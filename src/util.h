@@ -4,6 +4,9 @@
 #include <string>
 #include <ranges>
 #include <tuple>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
 
 /*------------------------------------------------------------------------------------------------*/
 
@@ -11,6 +14,47 @@ namespace ici {
 
     void string_to_file(const std::string& fname, const std::string& contents);
 
+    // raw binary I/O of trivially copyable values, and of vectors of them preceded by their
+    // length. Reading past the end of the stream throws.
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    void write_binary(std::ostream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    void write_binary(std::ostream& out, const std::vector<T>& values) {
+        write_binary(out, static_cast<uint64_t>(values.size()));
+        out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    T read_binary(std::istream& in) {
+        T value;
+        if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+            throw std::runtime_error("unexpected end of binary data");
+        }
+        return value;
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    std::vector<T> read_binary_vector(std::istream& in) {
+        auto n = read_binary<uint64_t>(in);
+        auto here = in.tellg();
+        in.seekg(0, std::ios::end);
+        auto remaining = static_cast<uint64_t>(in.tellg() - here);
+        in.seekg(here);
+        if (n > remaining / sizeof(T)) {
+            throw std::runtime_error("unexpected end of binary data");
+        }
+        std::vector<T> values(n);
+        in.read(reinterpret_cast<char*>(values.data()), n * sizeof(T));
+        return values;
+    }
+
+    size_t two_combinations_count(size_t n);
+    std::tuple<size_t, size_t> nth_two_combination(size_t n, size_t k);
+
     template <std::ranges::random_access_range R>
     auto two_combinations(R&& rng) {
         namespace r = std::ranges;
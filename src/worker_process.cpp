@@ -0,0 +1,375 @@
+#include "worker_process.h"
+#include <stdexcept>
+#include <format>
+#include <filesystem>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#ifdef __linux__
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#endif
+
+namespace fs = std::filesystem;
+namespace r = std::ranges;
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr size_t k_header_size = sizeof(uint32_t) + sizeof(uint64_t);
+
+    // a message as it goes on the wire.
+    std::string frame(const ici::message& msg) {
+        uint64_t size = msg.payload.size();
+        std::string bytes(k_header_size, '\0');
+        std::memcpy(bytes.data(), &msg.type, sizeof(msg.type));
+        std::memcpy(bytes.data() + sizeof(msg.type), &size, sizeof(size));
+        return bytes + msg.payload;
+    }
+
+#ifdef __linux__
+
+    std::runtime_error system_error(const char* what) {
+        return std::runtime_error(std::format("{}: {}", what, std::strerror(errno)));
+    }
+
+    void write_all(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            auto n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw system_error("unable to write to worker pipe");
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    void read_all(int fd, char* data, size_t size) {
+        while (size > 0) {
+            auto n = ::read(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw system_error("unable to read from worker pipe");
+            }
+            if (n == 0) {
+                throw std::runtime_error("worker pipe closed before the end of a message");
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+#else
+
+    [[noreturn]] void unsupported() {
+        throw std::runtime_error("worker processes are only supported on Linux");
+    }
+
+    void write_all(int, const char*, size_t) {
+        unsupported();
+    }
+
+    void read_all(int, char*, size_t) {
+        unsupported();
+    }
+
+#endif
+}
+
+void ici::send_message(int fd, const message& msg) {
+    auto bytes = frame(msg);
+    write_all(fd, bytes.data(), bytes.size());
+}
+
+ici::message ici::receive_message(int fd) {
+    uint32_t type;
+    uint64_t size;
+    read_all(fd, reinterpret_cast<char*>(&type), sizeof(type));
+    read_all(fd, reinterpret_cast<char*>(&size), sizeof(size));
+    message msg{ type, std::string(size, '\0') };
+    read_all(fd, msg.payload.data(), msg.payload.size());
+    return msg;
+}
+
+#ifdef __linux__
+
+namespace {
+
+    void set_nonblocking(int fd) {
+        auto flags = ::fcntl(fd, F_GETFL);
+        if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            throw system_error("unable to configure worker pipe");
+        }
+    }
+
+    // a message being received a piece at a time: its header, then its payload.
+    struct partial_message {
+        std::string header = std::string(k_header_size, '\0');
+        size_t received = 0;
+        ici::message msg{};
+
+        bool complete() const {
+            return received == k_header_size + msg.payload.size();
+        }
+
+        // reads what is available, returning false if nothing was.
+        bool read_from(int fd) {
+            char* dest = nullptr;
+            size_t wanted = 0;
+            if (received < k_header_size) {
+                dest = header.data() + received;
+                wanted = k_header_size - received;
+            } else {
+                dest = msg.payload.data() + (received - k_header_size);
+                wanted = msg.payload.size() - (received - k_header_size);
+            }
+            auto n = ::read(fd, dest, wanted);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN) {
+                    return false;
+                }
+                throw system_error("unable to read from worker pipe");
+            }
+            if (n == 0) {
+                throw std::runtime_error("worker pipe closed before the end of a message");
+            }
+            received += static_cast<size_t>(n);
+            if (received == k_header_size) {
+                uint64_t size;
+                std::memcpy(&msg.type, header.data(), sizeof(msg.type));
+                std::memcpy(&size, header.data() + sizeof(msg.type), sizeof(size));
+                msg.payload.resize(size);
+            }
+            return true;
+        }
+    };
+}
+
+std::vector<ici::message> ici::exchange_messages(std::span<const int> out_fds,
+        std::span<const message> outgoing, std::span<const int> in_fds) {
+    std::vector<std::string> sending;
+    std::vector<size_t> sent(out_fds.size(), 0);
+    for (size_t i = 0; i < out_fds.size(); ++i) {
+        set_nonblocking(out_fds[i]);
+        sending.push_back(frame(outgoing[i]));
+    }
+    std::vector<partial_message> receiving(in_fds.size());
+    for (auto fd : in_fds) {
+        set_nonblocking(fd);
+    }
+
+    std::vector<pollfd> polled;
+    std::vector<size_t> polled_index;
+    for (;;) {
+        polled.clear();
+        polled_index.clear();
+        for (size_t i = 0; i < out_fds.size(); ++i) {
+            if (sent[i] < sending[i].size()) {
+                polled.push_back({ out_fds[i], POLLOUT, 0 });
+                polled_index.push_back(i);
+            }
+        }
+        auto num_out = polled.size();
+        for (size_t i = 0; i < in_fds.size(); ++i) {
+            if (!receiving[i].complete()) {
+                polled.push_back({ in_fds[i], POLLIN, 0 });
+                polled_index.push_back(i);
+            }
+        }
+        if (polled.empty()) {
+            break;
+        }
+        if (::poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error("unable to wait on worker pipes");
+        }
+
+        for (size_t p = 0; p < polled.size(); ++p) {
+            if (polled[p].revents == 0) {
+                continue;
+            }
+            auto i = polled_index[p];
+            if (p >= num_out) {
+                receiving[i].read_from(in_fds[i]);
+                continue;
+            }
+            auto n = ::write(out_fds[i], sending[i].data() + sent[i], sending[i].size() - sent[i]);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN) {
+                    continue;
+                }
+                throw system_error("unable to write to worker pipe");
+            }
+            sent[i] += static_cast<size_t>(n);
+        }
+    }
+
+    std::vector<message> received;
+    for (auto& r : receiving) {
+        received.push_back(std::move(r.msg));
+    }
+    return received;
+}
+
+ici::sigpipe_ignored::sigpipe_ignored() {
+    struct sigaction ignore {};
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    ::sigaction(SIGPIPE, &ignore, &previous_);
+}
+
+ici::sigpipe_ignored::~sigpipe_ignored() {
+    ::sigaction(SIGPIPE, &previous_, nullptr);
+}
+
+ici::worker_process::worker_process(std::span<const std::pair<int, int>> inherited) :
+        pid_(-1), to_worker_(-1), from_worker_(-1) {
+    // both pipes are close-on-exec, so that each worker inherits only its own two ends,
+    // which the spawn moves to its standard input and output, and the descriptors it is
+    // handed, which the spawn duplicates without that flag.
+    int to[2];
+    int from[2];
+    if (::pipe2(to, O_CLOEXEC) != 0) {
+        throw system_error("unable to create worker pipe");
+    }
+    if (::pipe2(from, O_CLOEXEC) != 0) {
+        ::close(to[0]);
+        ::close(to[1]);
+        throw system_error("unable to create worker pipe");
+    }
+
+    auto exe = fs::read_symlink("/proc/self/exe").string();
+    std::string worker_arg = "--worker";
+    char* argv[] = { exe.data(), worker_arg.data(), nullptr };
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, to[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, from[1], STDOUT_FILENO);
+    for (auto [fd, as] : inherited) {
+        posix_spawn_file_actions_adddup2(&actions, fd, as);
+    }
+    auto result = ::posix_spawn(&pid_, exe.c_str(), &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    ::close(to[0]);
+    ::close(from[1]);
+    if (result != 0) {
+        ::close(to[1]);
+        ::close(from[0]);
+        errno = result;
+        throw system_error("unable to start worker process");
+    }
+    to_worker_ = to[1];
+    from_worker_ = from[0];
+}
+
+std::vector<std::unique_ptr<ici::worker_process>> ici::start_workers(size_t count,
+        std::vector<peer_channels>& channels) {
+    // every pipe between two workers is close-on-exec here and handed to its two workers
+    // as descriptors numbered past any of them, so that no duplication overwrites another
+    // that is still to be made. This process closes its copies once the workers have theirs.
+    std::vector<int> fds;
+    auto close_all = [&fds]() {
+        for (auto fd : fds) {
+            ::close(fd);
+        }
+    };
+    std::vector<std::vector<std::pair<int, int>>> pipes(count,
+        std::vector<std::pair<int, int>>(count, { -1, -1 }));
+    for (size_t a = 0; a < count; ++a) {
+        for (size_t b = 0; b < count; ++b) {
+            int ends[2];
+            if (a == b) {
+                continue;
+            }
+            if (::pipe2(ends, O_CLOEXEC) != 0) {
+                close_all();
+                throw system_error("unable to create worker pipe");
+            }
+            fds.push_back(ends[0]);
+            fds.push_back(ends[1]);
+            pipes[a][b] = { ends[0], ends[1] };
+        }
+    }
+    auto base = fds.empty() ? 0 : *r::max_element(fds) + 1;
+
+    std::vector<std::unique_ptr<worker_process>> workers;
+    channels.assign(count, { std::vector<int>(count, -1), std::vector<int>(count, -1) });
+    try {
+        for (size_t w = 0; w < count; ++w) {
+            std::vector<std::pair<int, int>> inherited;
+            for (size_t p = 0; p < count; ++p) {
+                if (p == w) {
+                    continue;
+                }
+                channels[w].from[p] = base + static_cast<int>(2 * p);
+                channels[w].to[p] = base + static_cast<int>(2 * p + 1);
+                inherited.emplace_back(pipes[p][w].first, channels[w].from[p]);
+                inherited.emplace_back(pipes[w][p].second, channels[w].to[p]);
+            }
+            workers.push_back(std::make_unique<worker_process>(inherited));
+        }
+    } catch (...) {
+        close_all();
+        throw;
+    }
+    close_all();
+    return workers;
+}
+
+ici::worker_process::~worker_process() {
+    // closing its input tells a worker that is still waiting for messages to exit.
+    ::close(to_worker_);
+    ::close(from_worker_);
+    int status;
+    while (::waitpid(pid_, &status, 0) < 0 && errno == EINTR) {
+    }
+}
+
+#else
+
+std::vector<ici::message> ici::exchange_messages(std::span<const int>,
+        std::span<const message>, std::span<const int>) {
+    unsupported();
+}
+
+ici::sigpipe_ignored::sigpipe_ignored() {
+}
+
+ici::sigpipe_ignored::~sigpipe_ignored() {
+}
+
+ici::worker_process::worker_process(std::span<const std::pair<int, int>>) :
+        pid_(-1), to_worker_(-1), from_worker_(-1) {
+    unsupported();
+}
+
+ici::worker_process::~worker_process() {
+}
+
+std::vector<std::unique_ptr<ici::worker_process>> ici::start_workers(size_t,
+        std::vector<peer_channels>&) {
+    unsupported();
+}
+
+#endif
+
+void ici::worker_process::send(const message& msg) const {
+    send_message(to_worker_, msg);
+}
+
+ici::message ici::worker_process::receive() const {
+    return receive_message(from_worker_);
+}
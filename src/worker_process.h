@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <span>
+#include <utility>
+#include <memory>
+#ifdef __linux__
+#include <signal.h>
+#endif
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace ici {
+
+    // a message between a coordinator and a worker: a type and a payload of bytes, framed on
+    // the wire by a header giving both. Only file descriptors are assumed, so a socket to a
+    // worker on another machine would do as well as a pipe.
+    struct message {
+        uint32_t type;
+        std::string payload;
+    };
+
+    void send_message(int fd, const message& msg);
+
+    // throws if the other end closes before a whole message arrives.
+    message receive_message(int fd);
+
+    // sends outgoing[i] on out_fds[i] while receiving one message on each of in_fds,
+    // interleaving them so that peers exchanging more than a pipe holds with each other do
+    // not each wait for the other to read. Returns the messages received, in the order of
+    // in_fds.
+    std::vector<message> exchange_messages(std::span<const int> out_fds,
+        std::span<const message> outgoing, std::span<const int> in_fds);
+
+    // ignores SIGPIPE while it exists, so that a worker that dies makes writes to it fail
+    // rather than kill the writing process, and then restores what was there before.
+    class sigpipe_ignored {
+#ifdef __linux__
+        struct sigaction previous_;
+#endif
+
+    public:
+        sigpipe_ignored();
+        sigpipe_ignored(const sigpipe_ignored&) = delete;
+        sigpipe_ignored& operator=(const sigpipe_ignored&) = delete;
+        ~sigpipe_ignored();
+    };
+
+    // a copy of this executable run with the --worker argument, talking to this process
+    // through a pipe to its standard input and one from its standard output. The worker
+    // also inherits each of inherited's first descriptors as the second. Linux only.
+    class worker_process {
+        int pid_;
+        int to_worker_;
+        int from_worker_;
+
+    public:
+        explicit worker_process(std::span<const std::pair<int, int>> inherited = {});
+        worker_process(const worker_process&) = delete;
+        worker_process& operator=(const worker_process&) = delete;
+        ~worker_process();
+
+        void send(const message& msg) const;
+        message receive() const;
+    };
+
+
+    // the descriptors a worker of a group reads from and writes to each of the others on,
+    // by peer; its own entries are -1.
+    struct peer_channels {
+        std::vector<int> from;
+        std::vector<int> to;
+    };
+
+    // starts count workers, each connected to every other one by a pipe each way, and sets
+    // channels to the descriptors each worker sees those pipes as.
+    std::vector<std::unique_ptr<worker_process>> start_workers(size_t count,
+        std::vector<peer_channels>& channels);
+
+}
@@ -0,0 +1,59 @@
+#include "../src/symmetry.h"
+#include <print>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+/*------------------------------------------------------------------------------------------------*/
+
+namespace {
+
+    constexpr double k_eps = 1e-9;
+
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::println("FAILED: {}", what);
+            ++failures;
+        }
+    }
+
+    bool same_circle(const ici::circle& a, const ici::circle& b) {
+        return std::abs(a.loc.x - b.loc.x) < 1e-7 && std::abs(a.loc.y - b.loc.y) < 1e-7 &&
+            std::abs(a.radius - b.radius) < 1e-7;
+    }
+
+    // seeds symmetric under the reflection across y = 0 and nothing else.
+    void mirror_images_share_a_representative() {
+        std::vector<ici::circle> seeds = {
+            { { 1.0, 1.0 }, 0.5 },
+            { { 1.0, -1.0 }, 0.5 },
+            { { 3.0, 0.0 }, 0.7 }
+        };
+        auto group = ici::detect_symmetry(seeds, k_eps);
+        check(group.dihedral() && group.order() == 1, "the seeds are detected as a mirror only");
+
+        auto upper = group.canonical(seeds[0], k_eps);
+        auto lower = group.canonical(seeds[1], k_eps);
+        check(same_circle(upper, lower), "mirror images canonicalize to one representative");
+        check(same_circle(group.canonical(upper, k_eps), upper), "representatives are fixed");
+    }
+
+    // under a dihedral group of order 4, every image of a circle has the same representative.
+    void orbits_share_a_representative() {
+        ici::symmetry_group group({ 0.0, 0.0 }, 4, true, 0.0);
+        ici::circle c{ { 2.0, 0.7 }, 0.3 };
+        auto rep = group.canonical(c, k_eps);
+        for (const auto& image : group.orbit(c)) {
+            check(same_circle(group.canonical(image, k_eps), rep),
+                "every image in an orbit canonicalizes to one representative");
+        }
+    }
+}
+
+int main() {
+    mirror_images_share_a_representative();
+    orbits_share_a_representative();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}